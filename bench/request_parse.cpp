@@ -0,0 +1,167 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   request_parse.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/time.h>
+#include "Request.hpp"
+
+// Per-request header parsing cost, before and after the single-pass
+// Request. "legacy" replays what a request used to pay: the header block
+// re-tokenized for Content-Length and Transfer-Encoding, and a copying
+// Request built for config selection and again for dispatch. "single"
+// is one offset-based parse plus the lookups the pipeline makes.
+
+static const char *kRequest =
+    "GET /assets/app.js?v=42 HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Referer: https://www.example.com/index.html\r\n"
+    "Cookie: session=8f14e45fceea167a5a36dedd4bea2543; theme=dark\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "\r\n";
+
+// The parser this tree had before the single-pass Request
+class LegacyRequest {
+private:
+    std::string _method;
+    std::string _path;
+    std::string _version;
+    std::map<std::string, std::string> _headers;
+    std::string _body;
+
+public:
+    explicit LegacyRequest(const std::string &raw_data) {
+        std::string data = raw_data;
+        size_t pos = data.find("\r\n\r\n");
+        std::string head_part = (pos != std::string::npos) ? data.substr(0, pos) : data;
+        if (pos != std::string::npos) {
+            _body = data.substr(pos + 4);
+        }
+        std::stringstream ss(head_part);
+        std::string line;
+        if (std::getline(ss, line)) {
+            if (!line.empty() && line[line.size() - 1] == '\r') {
+                line.erase(line.size() - 1);
+            }
+            std::stringstream request_line(line);
+            request_line >> _method >> _path >> _version;
+        }
+        while (std::getline(ss, line) && line != "\r" && !line.empty()) {
+            if (line[line.size() - 1] == '\r') {
+                line.erase(line.size() - 1);
+            }
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            std::string value = line.substr(colon + 1);
+            size_t first = value.find_first_not_of(' ');
+            if (first != std::string::npos) {
+                value = value.substr(first);
+            }
+            _headers[line.substr(0, colon)] = value;
+        }
+    }
+
+    const std::string &get_header(const std::string &key) const {
+        static std::string empty;
+        std::map<std::string, std::string>::const_iterator it = _headers.find(key);
+        return it != _headers.end() ? it->second : empty;
+    }
+    const std::string &get_path() const { return _path; }
+};
+
+static double now_us() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+static size_t legacy_request(const std::string &buffer) {
+    size_t header_end = buffer.find("\r\n\r\n");
+    size_t sink = 0;
+    // Config selection
+    LegacyRequest first(buffer);
+    sink += first.get_header("Host").size();
+    // Framing: the header block tokenized once more
+    std::stringstream ss(buffer.substr(0, header_end));
+    std::string line;
+    while (std::getline(ss, line)) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string key = line.substr(0, colon);
+        std::string value = line.substr(colon + 1);
+        if (key == "Content-Length") {
+            sink += std::strtoul(value.c_str(), NULL, 10);
+        }
+        if (key == "Transfer-Encoding" && value.find("chunked") != std::string::npos) {
+            ++sink;
+        }
+    }
+    // Dispatch
+    LegacyRequest second(buffer.substr(0, header_end + 4));
+    sink += second.get_header("Connection").size() + second.get_path().size();
+    return sink;
+}
+
+static size_t single_request(Request &req, const std::string &buffer) {
+    size_t header_end = buffer.find("\r\n\r\n") + 4;
+    size_t sink = 0;
+    if (!req.parse(buffer, header_end)) {
+        return 0;
+    }
+    size_t len = 0;
+    if (req.get_header_ref("Host", len)) {
+        sink += len;
+    }
+    if (req.get_header_ref("Content-Length", len)) {
+        sink += len;
+    }
+    sink += req.header_has_token("Transfer-Encoding", "chunked");
+    sink += req.header_has_token("Connection", "keep-alive");
+    sink += req.get_path().size();
+    return sink;
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? std::atol(argv[1]) : 200000;
+    std::string buffer(kRequest);
+    size_t sink = 0;
+
+    double start = now_us();
+    for (long i = 0; i < iterations; ++i) {
+        sink += legacy_request(buffer);
+    }
+    double legacy = (now_us() - start) * 1000.0 / iterations;
+
+    Request req; // Reused across requests, as a Client does
+    start = now_us();
+    for (long i = 0; i < iterations; ++i) {
+        sink += single_request(req, buffer);
+    }
+    double single = (now_us() - start) * 1000.0 / iterations;
+
+    std::printf("%ld requests of %lu header bytes\n", iterations, static_cast<unsigned long>(buffer.size()));
+    std::printf("legacy: %8.1f ns/request\n", legacy);
+    std::printf("single: %8.1f ns/request (%.1fx faster)\n", single, single > 0 ? legacy / single : 0.0);
+    return sink == 0; // Keeps the work from being optimized away
+}
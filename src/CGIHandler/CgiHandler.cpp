@@ -15,9 +15,13 @@
 #include <cstdlib>
 #include <cstring>
 #include <sstream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <signal.h>
 
-CgiHandler::CgiHandler(const Request& req, std::string script_path)
-    : _script_path(script_path), _body(req.get_body()), _cgi_pid(-1) {
+CgiHandler::CgiHandler(const Request& req, std::string script_path, std::string interpreter)
+    : _script_path(script_path), _interpreter(interpreter), _cgi_pid(-1), _stdin_fd(-1) {
     _init_env(req);
 }
 
@@ -47,53 +51,89 @@ void CgiHandler::_init_env(const Request& req) {
     }
 }
 
-char** CgiHandler::_get_env_char() {
-    char** envp = new char*[_env.size() + 1];
-    size_t idx = 0;
+// Built in the parent: nothing runs in the child before exec
+void CgiHandler::_build_envp(std::vector<std::string> &entries, std::vector<char*> &envp) const {
+    entries.reserve(_env.size());
     for (std::map<std::string, std::string>::const_iterator it = _env.begin(); it != _env.end(); ++it) {
-        std::string entry = it->first + "=" + it->second;
-        char* data = new char[entry.size() + 1];
-        std::strcpy(data, entry.c_str());
-        envp[idx++] = data;
+        entries.push_back(it->first + "=" + it->second);
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+        envp.push_back(const_cast<char*>(entries[i].c_str()));
     }
-    envp[idx] = NULL;
-    return envp;
+    envp.push_back(NULL);
+}
+
+// Both ends start close-on-exec; the child only keeps what it dup2()s
+static int open_pipe(int fds[2]) {
+#ifdef __linux__
+    return pipe2(fds, O_CLOEXEC);
+#else
+    if (pipe(fds) == -1) {
+        return -1;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+#endif
 }
-#include <unistd.h>
-#include <fcntl.h>
-#include <sys/wait.h>
 
 int CgiHandler::launch() {
     int pipe_fds[2];
-    if (pipe(pipe_fds) == -1) return -1;
+    int stdin_fds[2];
+    if (open_pipe(pipe_fds) == -1) return -1;
+    if (open_pipe(stdin_fds) == -1) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return -1;
+    }
 
-    // 1. Set the read-end of the pipe to NON-BLOCKING
+    // Set the server's ends of both pipes to NON-BLOCKING
     // This is vital so the Server doesn't hang if the script is slow.
     fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(stdin_fds[1], F_SETFL, O_NONBLOCK);
 
-    _cgi_pid = fork();
-    if (_cgi_pid == -1) {
-        close(pipe_fds[0]);
-        close(pipe_fds[1]);
-        return -1;
+    std::vector<std::string> env_entries;
+    std::vector<char*> envp;
+    _build_envp(env_entries, envp);
+    std::vector<char*> argv;
+    if (!_interpreter.empty()) {
+        argv.push_back(const_cast<char*>(_interpreter.c_str()));
     }
+    argv.push_back(const_cast<char*>(_script_path.c_str()));
+    argv.push_back(NULL);
 
-    if (_cgi_pid == 0) {
-        // --- CHILD PROCESS ---
-        // Redirect STDOUT to the write-end of the pipe
-        dup2(pipe_fds[1], STDOUT_FILENO);
-        close(pipe_fds[0]);
-        close(pipe_fds[1]);
+    // dup2() clears close-on-exec on the child's stdin and stdout only
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, stdin_fds[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
 
-        char* args[] = { (char*)_script_path.c_str(), NULL };
-        char** envp = _get_env_char();
+    // The server ignores SIGPIPE; the script gets the default back
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &signals);
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attr, &signals);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
 
-        execve(args[0], args, envp);
-        // If execve fails, exit immediately to prevent a zombie child
-        exit(1); 
-    }
+    // glibc spawns with CLONE_VM | CLONE_VFORK, so the cost does not grow
+    // with the server's memory, and exec failures are reported here
+    int rc = posix_spawn(&_cgi_pid, argv[0], &actions, &attr, &argv[0], &envp[0]);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
 
-    // --- PARENT PROCESS ---
-    close(pipe_fds[1]); // Close the write-end in the parent
+    close(pipe_fds[1]); // The child's ends are only needed by the child
+    close(stdin_fds[0]);
+    if (rc != 0) {
+        std::cerr << "Could not start CGI " << _script_path << ": " << std::strerror(rc) << std::endl;
+        close(pipe_fds[0]);
+        close(stdin_fds[1]);
+        _cgi_pid = -1;
+        return -1;
+    }
+    _stdin_fd = stdin_fds[1];
     return pipe_fds[0]; // Return the read-end to be added to poll()
 }
@@ -26,23 +26,30 @@
 class CgiHandler {
 private:
     std::string                         _script_path;
-    std::string                         _body;
+    std::string                         _interpreter; // Empty: the script is executed itself
     std::map<std::string, std::string>  _env;
     pid_t                               _cgi_pid;
+    int                                 _stdin_fd;  // Write-end of the script's stdin
 
     void    _init_env(const Request& req);
-    char** _get_env_char(); // Remember to free this memory in the .cpp!
+    void    _build_envp(std::vector<std::string> &entries, std::vector<char*> &envp) const;
 
 public:
-    CgiHandler(const Request& req, std::string script_path);
+    CgiHandler(const Request& req, std::string script_path, std::string interpreter = "");
     ~CgiHandler() {}
 
-    // Changes 'execute' (blocking) to 'launch' (non-blocking)
-    // Returns the read-end of the pipe to the Server
+    // Spawns the script without copying the server's address space
+    // Returns the read-end of the pipe to the Server, -1 on failure
     int     launch();
 
     // Getter for the PID so the Server can call waitpid(pid, ...)
     pid_t   get_pid() const { return _cgi_pid; }
+    // Non-blocking; the Server feeds the request body through it
+    int     get_stdin_fd() const { return _stdin_fd; }
+    // The CGI/1.1 variables, also sent as FastCGI params
+    const std::map<std::string, std::string>& get_env() const { return _env; }
+    // Overrides a variable before launch()
+    void    set_env(const std::string &name, const std::string &value) { _env[name] = value; }
 };
 
 #endif
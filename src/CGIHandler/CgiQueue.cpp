@@ -0,0 +1,108 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CgiQueue.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "CgiQueue.hpp"
+
+CgiQueue::Gate::Gate()
+    : running(0), admitted(0), queued(0), rejected(0), expired(0), peak_depth(0),
+      wait_total(0), wait_max(0), waited(0) {}
+
+e_admission CgiQueue::admit(const RouteConfig &route, int fd, msec_t now) {
+    if (route.cgi_max_concurrent == 0) {
+        return ADMISSION_RUN;
+    }
+    Gate &gate = _gates[&route];
+    // Waiters are replayed as soon as a slot frees, so a free slot means
+    // nobody is ahead of this request
+    if (gate.running < route.cgi_max_concurrent) {
+        ++gate.running;
+        ++gate.admitted;
+        return ADMISSION_RUN;
+    }
+    if (gate.waiting.size() >= route.cgi_queue_size) {
+        ++gate.rejected;
+        return ADMISSION_REJECTED;
+    }
+    Waiter waiter;
+    waiter.fd = fd;
+    waiter.since = now;
+    gate.waiting.push_back(waiter);
+    ++gate.queued;
+    if (gate.waiting.size() > gate.peak_depth) {
+        gate.peak_depth = gate.waiting.size();
+    }
+    return ADMISSION_QUEUED;
+}
+
+void CgiQueue::release(const RouteConfig *route) {
+    GateMap::iterator it = _gates.find(route);
+    if (it != _gates.end() && it->second.running > 0) {
+        --it->second.running;
+    }
+}
+
+bool CgiQueue::next_waiter(const RouteConfig *route, msec_t now, int &fd) {
+    GateMap::iterator it = _gates.find(route);
+    if (it == _gates.end() || it->second.waiting.empty()
+            || it->second.running >= route->cgi_max_concurrent) {
+        return false;
+    }
+    Gate &gate = it->second;
+    msec_t waited = now - gate.waiting.front().since;
+    fd = gate.waiting.front().fd;
+    gate.waiting.pop_front();
+    gate.wait_total += waited;
+    if (waited > gate.wait_max) {
+        gate.wait_max = waited;
+    }
+    ++gate.waited;
+    return true;
+}
+
+void CgiQueue::cancel(const RouteConfig *route, int fd, bool expired) {
+    GateMap::iterator it = _gates.find(route);
+    if (it == _gates.end()) {
+        return;
+    }
+    std::deque<Waiter> &waiting = it->second.waiting;
+    for (std::deque<Waiter>::iterator w = waiting.begin(); w != waiting.end(); ++w) {
+        if (w->fd == fd) {
+            waiting.erase(w);
+            if (expired) {
+                ++it->second.expired;
+            }
+            return;
+        }
+    }
+}
+
+void CgiQueue::report(std::ostream &out) {
+    for (GateMap::iterator it = _gates.begin(); it != _gates.end(); ++it) {
+        Gate &gate = it->second;
+        if (gate.admitted == 0 && gate.queued == 0 && gate.rejected == 0 && gate.running == 0) {
+            continue;
+        }
+        out << "CGI queue " << it->first->path << ": " << gate.running << '/' << it->first->cgi_max_concurrent
+            << " running, " << gate.waiting.size() << " waiting (peak " << gate.peak_depth << "), "
+            << gate.admitted << " admitted, " << gate.queued << " queued, avg wait "
+            << (gate.waited ? gate.wait_total / gate.waited : 0) << " ms (max " << gate.wait_max << " ms), "
+            << gate.rejected << " rejected, " << gate.expired << " timed out" << std::endl;
+        gate.admitted = 0;
+        gate.queued = 0;
+        gate.rejected = 0;
+        gate.expired = 0;
+        gate.peak_depth = gate.waiting.size();
+        gate.wait_total = 0;
+        gate.wait_max = 0;
+        gate.waited = 0;
+    }
+}
@@ -0,0 +1,71 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CgiQueue.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGI_QUEUE_HPP
+#define CGI_QUEUE_HPP
+
+#include <map>
+#include <deque>
+#include <ostream>
+#include "Config.hpp"
+#include "TimerWheel.hpp"
+
+enum e_admission {
+    ADMISSION_RUN,      // A slot was taken, spawn the script now
+    ADMISSION_QUEUED,   // Wait for a slot; replayed when one frees up
+    ADMISSION_REJECTED  // Queue full, answer 503
+};
+
+// Admission control for locations with cgi_max_concurrent. A slot is held
+// from spawn until the reaper collects the child, so the limit counts real
+// processes. Requests over the limit wait in a per-location FIFO of client
+// fds, up to cgi_queue_size of them; the rest are turned away.
+class CgiQueue {
+private:
+    struct Waiter {
+        int     fd;
+        msec_t  since;
+    };
+    struct Gate {
+        size_t              running;
+        std::deque<Waiter>  waiting;
+        // Counters since the last report
+        size_t              admitted;
+        size_t              queued;
+        size_t              rejected;
+        size_t              expired;
+        size_t              peak_depth;
+        msec_t              wait_total;     // Over requests admitted from the queue
+        msec_t              wait_max;
+        size_t              waited;
+
+        Gate();
+    };
+    typedef std::map<const RouteConfig*, Gate> GateMap;
+
+    GateMap _gates;
+
+public:
+    // Limited locations only; others always run
+    e_admission admit(const RouteConfig &route, int fd, msec_t now);
+    // The child holding a slot exited
+    void        release(const RouteConfig *route);
+    // Pops the oldest waiter when a slot is free; false when none can run
+    bool        next_waiter(const RouteConfig *route, msec_t now, int &fd);
+    // A waiter timed out ('expired') or went away
+    void        cancel(const RouteConfig *route, int fd, bool expired);
+
+    // One line per location that saw traffic, then the counters restart
+    void        report(std::ostream &out);
+};
+
+#endif
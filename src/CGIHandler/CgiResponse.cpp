@@ -0,0 +1,361 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CgiResponse.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "CgiResponse.hpp"
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+
+const size_t CgiResponse::kMaxHeaderSize;
+
+CgiResponse::CgiResponse()
+    : _mode(MODE_HEADERS), _scan_pos(0), _remaining(0), _finished(false), _keep_alive(false),
+      _chunked_allowed(false), _head_only(false), _capturing(false), _capture_limit(0),
+      _status(0), _private(false), _max_age(-1), _expires(-1) {}
+
+void CgiResponse::reset(bool keep_alive, bool chunked_allowed, bool head_only) {
+    _mode = MODE_HEADERS;
+    _header.clear();
+    _scan_pos = 0;
+    _remaining = 0;
+    _finished = false;
+    _keep_alive = keep_alive;
+    _chunked_allowed = chunked_allowed;
+    _head_only = head_only;
+    _capturing = false;
+    _capture_limit = 0;
+    _status = 0;
+    _private = false;
+    _max_age = -1;
+    _expires = -1;
+    _captured_head.clear();
+    _captured_body.clear();
+}
+
+void CgiResponse::capture(size_t limit) {
+    _capturing = true;
+    _capture_limit = limit;
+}
+
+static std::string lowercase(const std::string &s) {
+    std::string out(s);
+    for (size_t i = 0; i < out.size(); ++i) {
+        out[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(out[i])));
+    }
+    return out;
+}
+
+// For a Status header that gives only the code; the reason phrase may be
+// empty, but the space before it may not
+static const char *default_reason(int code) {
+    switch (code) {
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 303: return "See Other";
+    case 304: return "Not Modified";
+    case 307: return "Temporary Redirect";
+    case 308: return "Permanent Redirect";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 410: return "Gone";
+    case 413: return "Payload Too Large";
+    case 429: return "Too Many Requests";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    default:  return "";
+    }
+}
+
+static std::string trim(const std::string &s) {
+    size_t start = s.find_first_not_of(" \t");
+    if (start == std::string::npos) {
+        return "";
+    }
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(start, end - start + 1);
+}
+
+CgiResponse::e_result CgiResponse::feed(const char *data, size_t len, OutputQueue &out) {
+    if (_mode == MODE_ERROR) {
+        return CGI_ERROR;
+    }
+    if (_mode != MODE_HEADERS) {
+        _forward(data, len, out);
+        return CGI_STREAMING;
+    }
+    _header.append(data, len);
+    if (_header.size() >= 5 && _header.compare(0, 5, "HTTP/") == 0) {
+        // Non-parsed-header script: it framed the response itself
+        _mode = MODE_RAW;
+        _keep_alive = false;
+        _capturing = false;
+        out.append_owned(_header);
+        return CGI_STREAMING;
+    }
+    // Lines end in "\n" or "\r\n"; an empty one ends the block
+    size_t pos = _scan_pos;
+    while (true) {
+        size_t nl = _header.find('\n', pos);
+        if (nl == std::string::npos) {
+            break;
+        }
+        size_t line_start = pos;
+        pos = nl + 1;
+        if (nl == line_start || (nl == line_start + 1 && _header[line_start] == '\r')) {
+            if (!_emit_head(line_start, out)) {
+                _mode = MODE_ERROR;
+                return CGI_ERROR;
+            }
+            std::string body = _header.substr(pos);
+            _header.clear();
+            _forward(body.data(), body.size(), out);
+            return CGI_STREAMING;
+        }
+    }
+    _scan_pos = pos;
+    if (_header.size() > kMaxHeaderSize) {
+        _mode = MODE_ERROR;
+        return CGI_ERROR;
+    }
+    return CGI_NEED_MORE;
+}
+
+bool CgiResponse::_emit_head(size_t header_len, OutputQueue &out) {
+    std::string status = "200 OK";
+    bool status_set = false;
+    bool has_location = false;
+    bool has_length = false;
+    std::string headers;
+    std::string length_line;
+
+    size_t pos = 0;
+    while (pos < header_len) {
+        size_t nl = _header.find('\n', pos);
+        std::string line = _header.substr(pos, nl - pos);
+        pos = nl + 1;
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+        size_t colon = line.find(':');
+        if (colon == std::string::npos || colon == 0) {
+            return false;
+        }
+        std::string name = lowercase(line.substr(0, colon));
+        std::string value = trim(line.substr(colon + 1));
+        if (name == "status") {
+            if (value.size() < 3 || !std::isdigit(static_cast<unsigned char>(value[0]))
+                    || !std::isdigit(static_cast<unsigned char>(value[1]))
+                    || !std::isdigit(static_cast<unsigned char>(value[2]))
+                    || (value.size() > 3 && value[3] != ' ')) {
+                return false;
+            }
+            status = value;
+            if (status.size() == 3) {
+                status += std::string(" ") + default_reason(std::atoi(status.c_str()));
+            }
+            status_set = true;
+            continue;
+        }
+        if (name == "connection" || name == "transfer-encoding" || name == "keep-alive") {
+            continue; // Hop-by-hop: the server frames the response
+        }
+        if (name == "content-length") {
+            char *end = NULL;
+            unsigned long length = std::strtoul(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0') {
+                return false;
+            }
+            _remaining = static_cast<size_t>(length);
+            has_length = true;
+            length_line = line + "\r\n";
+            continue;
+        } else if (name == "location") {
+            has_location = true;
+        } else if (name == "cache-control" || name == "expires" || name == "set-cookie") {
+            _note_cache_header(name, value);
+        }
+        headers += line;
+        headers += "\r\n";
+    }
+    if (!status_set && has_location) {
+        status = "302 Found";
+    }
+
+    _status = std::atoi(status.c_str());
+    // 1xx, 204 and 304 never carry a body: no framing, and whatever the
+    // script prints after the header is dropped
+    bool bodyless = (_status >= 100 && _status < 200) || _status == 204 || _status == 304;
+    std::string head = "HTTP/1.1 " + status + "\r\n" + headers;
+    if (!bodyless) {
+        head += length_line;
+    }
+    if (_capturing) {
+        _captured_head = head;
+    }
+    if (bodyless) {
+        _mode = MODE_LENGTH;
+        _remaining = 0;
+        _head_only = true;
+    } else if (has_length) {
+        _mode = MODE_LENGTH;
+    } else if (_chunked_allowed) {
+        _mode = MODE_CHUNKED;
+        head += "Transfer-Encoding: chunked\r\n";
+    } else {
+        _mode = MODE_RAW;
+        _keep_alive = false;
+    }
+    head += _keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    out.append_owned(head);
+    return true;
+}
+
+// Cache-Control wins over Expires whatever their order, so Expires is
+// kept apart until the head is done. A cookie-setting response is private,
+// and nothing later in the head can make it shared again.
+void CgiResponse::_note_cache_header(const std::string &name, const std::string &value) {
+    if (name == "set-cookie") {
+        _private = true;
+        return;
+    }
+    if (name == "expires") {
+        struct tm tm;
+        std::memset(&tm, 0, sizeof(tm));
+        if (strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S", &tm)) {
+            long age = static_cast<long>(timegm(&tm) - time(NULL));
+            _expires = age > 0 ? age : 0;
+        } else {
+            _expires = 0; // Invalid dates mean already expired (RFC 9111)
+        }
+        return;
+    }
+    std::string directives = lowercase(value);
+    if (directives.find("no-store") != std::string::npos || directives.find("no-cache") != std::string::npos
+            || directives.find("private") != std::string::npos) {
+        _private = true;
+        return;
+    }
+    // s-maxage is meant for shared caches like this one, so it beats max-age
+    size_t pos = directives.find("s-maxage=");
+    if (pos != std::string::npos) {
+        _max_age = std::atol(directives.c_str() + pos + 9);
+        return;
+    }
+    pos = directives.find("max-age=");
+    if (pos != std::string::npos && _max_age == -1) {
+        _max_age = std::atol(directives.c_str() + pos + 8);
+    }
+}
+
+void CgiResponse::_forward(const char *data, size_t len, OutputQueue &out) {
+    if (len == 0 || _head_only) {
+        return;
+    }
+    if (_mode == MODE_LENGTH) {
+        // Anything past the announced length would corrupt the next response
+        if (len > _remaining) {
+            len = _remaining;
+        }
+        _remaining -= len;
+    }
+    if (_capturing) {
+        if (_captured_body.size() + len > _capture_limit) {
+            _capturing = false; // Too big to cache, stream only
+            std::string().swap(_captured_body);
+        } else {
+            _captured_body.append(data, len);
+        }
+    }
+    if (_mode == MODE_LENGTH) {
+        if (len > 0) {
+            out.append_copy(data, len);
+        }
+        return;
+    }
+    if (_mode == MODE_CHUNKED) {
+        static const char digits[] = "0123456789abcdef";
+        char size_line[sizeof(size_t) * 2 + 2];
+        size_t n = sizeof(size_line);
+        size_line[--n] = '\n';
+        size_line[--n] = '\r';
+        size_t value = len;
+        do {
+            size_line[--n] = digits[value & 0xf];
+            value >>= 4;
+        } while (value > 0);
+        // Merged into one owned segment with the payload
+        out.append_copy(size_line + n, sizeof(size_line) - n);
+        out.append_copy(data, len);
+        out.append_copy("\r\n", 2);
+        return;
+    }
+    out.append_copy(data, len);
+}
+
+bool CgiResponse::finish(OutputQueue &out) {
+    if (!headers_sent()) {
+        return false;
+    }
+    if (_mode == MODE_CHUNKED && !_head_only) {
+        out.append_static("0\r\n\r\n");
+    }
+    _finished = true;
+    return true;
+}
+
+bool CgiResponse::cacheable(std::string &head, std::string &body, long &max_age) {
+    // A chunked body has no length to check: only a clean EOF proves it whole
+    bool complete = (_mode == MODE_CHUNKED && _finished) || (_mode == MODE_LENGTH && _remaining == 0);
+    long freshness = _max_age != -1 ? _max_age : _expires;
+    if (!_capturing || !complete || _private || freshness == 0) {
+        return false;
+    }
+    // The statuses RFC 9111 lets a cache store without explicit freshness
+    if (_status != 200 && _status != 203 && _status != 300 && _status != 301
+            && _status != 404 && _status != 410) {
+        return false;
+    }
+    head = _captured_head;
+    if (_mode == MODE_CHUNKED) {
+        std::stringstream length;
+        length << "Content-Length: " << _captured_body.size() << "\r\n";
+        head += length.str();
+    }
+    body.swap(_captured_body);
+    max_age = freshness;
+    return true;
+}
+
+bool CgiResponse::keep_alive() const {
+    if (!_keep_alive) {
+        return false;
+    }
+    if (_head_only || _mode == MODE_CHUNKED) {
+        return true;
+    }
+    return _mode == MODE_LENGTH && _remaining == 0;
+}
@@ -0,0 +1,85 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CgiResponse.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGI_RESPONSE_HPP
+#define CGI_RESPONSE_HPP
+
+#include <string>
+#include <cstddef>
+#include "OutputQueue.hpp"
+
+// Turns a script's CGI/1.1 output into an HTTP/1.1 response as it arrives.
+// Header lines are held until the blank line, then become a status line
+// and header block ("Status:" and "Location:" included); body bytes go to
+// the OutputQueue right away, chunked when the script gave no
+// Content-Length. Output starting with "HTTP/" is passed through as-is.
+class CgiResponse {
+public:
+    static const size_t kMaxHeaderSize = 16384;
+
+    enum e_result {
+        CGI_NEED_MORE,      // Headers not complete yet
+        CGI_STREAMING,      // Headers queued, body is being forwarded
+        CGI_ERROR           // Malformed or oversized headers
+    };
+
+private:
+    enum e_mode {
+        MODE_HEADERS,
+        MODE_LENGTH,        // Content-Length given by the script
+        MODE_CHUNKED,
+        MODE_RAW,           // Close-delimited: HTTP/1.0 client or NPH output
+        MODE_ERROR
+    };
+
+    e_mode      _mode;
+    std::string _header;        // Header bytes until the blank line
+    size_t      _scan_pos;      // How far _header was searched for it
+    size_t      _remaining;     // MODE_LENGTH: body bytes still expected
+    bool        _finished;      // finish() saw the script's output end cleanly
+    bool        _keep_alive;
+    bool        _chunked_allowed;
+    bool        _head_only;
+    bool        _capturing;     // Keeping a copy for the micro-cache
+    size_t      _capture_limit;
+    int         _status;
+    bool        _private;       // Set-Cookie, private, no-store or no-cache: never shared
+    long        _max_age;       // From Cache-Control, -1 without one
+    long        _expires;       // Seconds left per Expires, -1 without one
+    std::string _captured_head; // Status line and headers, no framing
+    std::string _captured_body;
+
+    bool    _emit_head(size_t header_len, OutputQueue &out);
+    void    _forward(const char *data, size_t len, OutputQueue &out);
+    void    _note_cache_header(const std::string &name, const std::string &value);
+
+public:
+    CgiResponse();
+
+    void        reset(bool keep_alive, bool chunked_allowed, bool head_only);
+    e_result    feed(const char *data, size_t len, OutputQueue &out);
+    // End of the script's output: terminates a chunked body. Returns false
+    // when no valid header block was ever seen.
+    bool        finish(OutputQueue &out);
+    // Keeps a copy of the response, up to 'limit' bytes of body
+    void        capture(size_t limit);
+    // After finish(): the response as a cacheable head and body, with the
+    // lifetime the script asked for (-1 when it said nothing). False when
+    // it may not be cached, or the output was cut short.
+    bool        cacheable(std::string &head, std::string &body, long &max_age);
+
+    bool    headers_sent() const { return _mode != MODE_HEADERS && _mode != MODE_ERROR; }
+    // Whether the framing lets the connection carry another request
+    bool    keep_alive() const;
+};
+
+#endif
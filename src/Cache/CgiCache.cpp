@@ -0,0 +1,123 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CgiCache.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "CgiCache.hpp"
+
+static const size_t kMaxPasses = 4096;
+
+CgiCache::CgiCache() : _bytes(0), _max_bytes(0), _max_entry_size(0) {}
+
+CgiCache::~CgiCache() {
+    while (!_lru.empty()) {
+        _evict(_entries.find(_lru.back()));
+    }
+}
+
+void CgiCache::configure(size_t max_bytes, size_t max_entry_size) {
+    _max_bytes = max_bytes;
+    _max_entry_size = max_entry_size;
+    while (_bytes > _max_bytes && !_lru.empty()) {
+        _evict(_entries.find(_lru.back()));
+    }
+}
+
+void CgiCache::_evict(EntryMap::iterator it) {
+    if (it == _entries.end()) {
+        return;
+    }
+    _bytes -= it->second.entry.response->data().size();
+    it->second.entry.response->release();
+    _lru.erase(it->second.lru);
+    _entries.erase(it);
+}
+
+const CgiCache::Entry* CgiCache::lookup(const std::string &key, msec_t now) {
+    EntryMap::iterator it = _entries.find(key);
+    if (it == _entries.end()) {
+        return NULL;
+    }
+    if (now >= it->second.entry.expires) {
+        _evict(it);
+        return NULL;
+    }
+    _lru.splice(_lru.begin(), _lru, it->second.lru);
+    return &it->second.entry;
+}
+
+void CgiCache::store(const std::string &key, const std::string &head, const std::string &body, msec_t expires) {
+    size_t cost = head.size() + body.size();
+    if (!enabled() || cost > _max_entry_size || cost > _max_bytes) {
+        return;
+    }
+    _evict(_entries.find(key));
+    _passes.erase(key);
+    while (_bytes + cost > _max_bytes && !_lru.empty()) {
+        _evict(_entries.find(_lru.back()));
+    }
+    _lru.push_front(key);
+    Slot &slot = _entries[key];
+    slot.lru = _lru.begin();
+    slot.entry.response = new SharedBuffer(head + body);
+    slot.entry.head_size = head.size();
+    slot.entry.expires = expires;
+    _bytes += cost;
+}
+
+void CgiCache::mark_uncacheable(const std::string &key, msec_t until) {
+    if (_passes.size() >= kMaxPasses) {
+        _passes.clear(); // Forgetting only costs a collapsed wait
+    }
+    _passes[key] = until;
+}
+
+bool CgiCache::is_passed(const std::string &key, msec_t now) {
+    std::map<std::string, msec_t>::iterator it = _passes.find(key);
+    if (it == _passes.end()) {
+        return false;
+    }
+    if (now >= it->second) {
+        _passes.erase(it);
+        return false;
+    }
+    return true;
+}
+
+void CgiCache::begin_fill(const std::string &key) {
+    _fills[key];
+}
+
+void CgiCache::wait(const std::string &key, int fd) {
+    _fills[key].push_back(fd);
+}
+
+void CgiCache::cancel_wait(const std::string &key, int fd) {
+    std::map<std::string, std::vector<int> >::iterator it = _fills.find(key);
+    if (it == _fills.end()) {
+        return;
+    }
+    std::vector<int> &fds = it->second;
+    for (size_t i = 0; i < fds.size(); ++i) {
+        if (fds[i] == fd) {
+            fds.erase(fds.begin() + i);
+            return;
+        }
+    }
+}
+
+void CgiCache::end_fill(const std::string &key, std::vector<int> &waiters) {
+    std::map<std::string, std::vector<int> >::iterator it = _fills.find(key);
+    if (it == _fills.end()) {
+        return;
+    }
+    waiters.swap(it->second);
+    _fills.erase(it);
+}
@@ -0,0 +1,84 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CgiCache.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGI_CACHE_HPP
+#define CGI_CACHE_HPP
+
+#include <string>
+#include <map>
+#include <list>
+#include <vector>
+#include "SharedBuffer.hpp"
+#include "TimerWheel.hpp"
+
+// Micro-cache for script responses in locations with cgi_cache. Entries
+// hold the serialized response like StaticCache and expire after the TTL
+// the script or the location gave them. While one request for a key runs
+// its script, identical requests wait on the fill instead of spawning
+// their own; keys whose last response could not be cached are passed
+// through for a while so they do not queue behind each other.
+class CgiCache {
+public:
+    struct Entry {
+        SharedBuffer    *response;  // Head (minus Connection and the blank line), then body
+        size_t          head_size;
+        msec_t          expires;
+    };
+
+private:
+    typedef std::list<std::string> LruList;
+    struct Slot {
+        Entry               entry;
+        LruList::iterator   lru;
+    };
+    typedef std::map<std::string, Slot> EntryMap;
+
+    EntryMap    _entries;
+    LruList     _lru;           // Front is the most recently used key
+    size_t      _bytes;
+    size_t      _max_bytes;
+    size_t      _max_entry_size;
+    std::map<std::string, msec_t>               _passes;    // Value: until when
+    std::map<std::string, std::vector<int> >    _fills;     // Value: fds of waiting clients
+
+    void    _evict(EntryMap::iterator it);
+
+    CgiCache(const CgiCache &);
+    CgiCache &operator=(const CgiCache &);
+
+public:
+    CgiCache();
+    ~CgiCache();
+
+    void    configure(size_t max_bytes, size_t max_entry_size);
+    bool    enabled() const { return _max_bytes > 0; }
+    size_t  max_entry_size() const { return _max_entry_size; }
+
+    // Returns NULL on a miss or an expired entry
+    const Entry*    lookup(const std::string &key, msec_t now);
+    void            store(const std::string &key, const std::string &head, const std::string &body, msec_t expires);
+    void            mark_uncacheable(const std::string &key, msec_t until);
+    bool            is_passed(const std::string &key, msec_t now);
+
+    // Collapsed forwarding
+    bool    filling(const std::string &key) const { return _fills.count(key) != 0; }
+    void    begin_fill(const std::string &key);
+    void    wait(const std::string &key, int fd);
+    void    cancel_wait(const std::string &key, int fd);
+    // Ends the fill and hands back the fds that waited on it
+    void    end_fill(const std::string &key, std::vector<int> &waiters);
+
+    size_t  size_bytes() const { return _bytes; }
+    size_t  entry_count() const { return _entries.size(); }
+};
+
+#endif
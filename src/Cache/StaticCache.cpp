@@ -0,0 +1,127 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   StaticCache.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "StaticCache.hpp"
+
+StaticCache::StaticCache()
+    : _bytes(0), _max_bytes(0), _max_file_size(0), _revalidate(0) {}
+
+StaticCache::~StaticCache() {
+    while (!_lru.empty()) {
+        _evict(_entries.find(_lru.back()));
+    }
+}
+
+void StaticCache::configure(size_t max_bytes, size_t max_file_size, time_t revalidate) {
+    _max_bytes = max_bytes;
+    _max_file_size = max_file_size;
+    _revalidate = revalidate;
+    while (_bytes > _max_bytes && !_lru.empty()) {
+        _evict(_entries.find(_lru.back()));
+    }
+}
+
+bool StaticCache::fits(off_t size) const {
+    return enabled() && size >= 0 && static_cast<size_t>(size) <= _max_file_size;
+}
+
+void StaticCache::_evict(EntryMap::iterator it) {
+    if (it == _entries.end()) {
+        return;
+    }
+    _bytes -= it->second.entry.response->data().size();
+    it->second.entry.response->release();
+    _lru.erase(it->second.lru);
+    _entries.erase(it);
+}
+
+static bool unchanged(const std::string &path, time_t mtime, off_t size, ino_t inode) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && st.st_mtime == mtime && st.st_size == size && st.st_ino == inode;
+}
+
+// The plain file and the sidecar the body came from are unchanged, and no
+// sidecar that Response would now prefer has appeared (or become fresh)
+bool StaticCache::_still_valid(const Entry &entry) {
+    if (!unchanged(entry.file_path, entry.mtime, entry.size, entry.inode)) {
+        return false;
+    }
+    if (!entry.sidecar_path.empty()
+            && !unchanged(entry.sidecar_path, entry.sidecar_mtime, entry.sidecar_size, entry.sidecar_inode)) {
+        return false;
+    }
+    for (size_t i = 0; i < entry.skipped_sidecars.size(); ++i) {
+        struct stat st;
+        if (stat(entry.skipped_sidecars[i].c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_mtime >= entry.mtime) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const StaticCache::Entry* StaticCache::lookup(const std::string &key) {
+    EntryMap::iterator it = _entries.find(key);
+    if (it == _entries.end()) {
+        return NULL;
+    }
+    Entry &entry = it->second.entry;
+    time_t now = time(NULL);
+    if (now - entry.checked_at >= _revalidate) {
+        if (!_still_valid(entry)) {
+            _evict(it);
+            return NULL;
+        }
+        entry.checked_at = now;
+    }
+    // Move to the front of the LRU list without reallocating the node
+    _lru.splice(_lru.begin(), _lru, it->second.lru);
+    return &entry;
+}
+
+const StaticCache::Entry* StaticCache::store(const std::string &key, const std::string &header,
+                                             const std::string &body, const std::string &file_path,
+                                             const struct stat &st, const std::string &sidecar_path,
+                                             const struct stat &sidecar_st,
+                                             const std::vector<std::string> &skipped_sidecars,
+                                             const std::string &etag, const std::string &validators) {
+    size_t cost = header.size() + body.size();
+    if (!enabled() || cost > _max_bytes) {
+        return NULL;
+    }
+    invalidate(key);
+    while (_bytes + cost > _max_bytes && !_lru.empty()) {
+        _evict(_entries.find(_lru.back()));
+    }
+    _lru.push_front(key);
+    Slot &slot = _entries[key];
+    slot.lru = _lru.begin();
+    slot.entry.response = new SharedBuffer(header + body);
+    slot.entry.head_size = header.size();
+    slot.entry.file_path = file_path;
+    slot.entry.mtime = st.st_mtime;
+    slot.entry.size = st.st_size;
+    slot.entry.inode = st.st_ino;
+    slot.entry.sidecar_path = sidecar_path;
+    slot.entry.sidecar_mtime = sidecar_path.empty() ? 0 : sidecar_st.st_mtime;
+    slot.entry.sidecar_size = sidecar_path.empty() ? 0 : sidecar_st.st_size;
+    slot.entry.sidecar_inode = sidecar_path.empty() ? 0 : sidecar_st.st_ino;
+    slot.entry.skipped_sidecars = skipped_sidecars;
+    slot.entry.checked_at = time(NULL);
+    slot.entry.etag = etag;
+    slot.entry.validators = validators;
+    _bytes += cost;
+    return &slot.entry;
+}
+
+void StaticCache::invalidate(const std::string &key) {
+    _evict(_entries.find(key));
+}
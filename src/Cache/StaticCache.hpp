@@ -0,0 +1,91 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   StaticCache.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef STATIC_CACHE_HPP
+#define STATIC_CACHE_HPP
+
+#include <string>
+#include <map>
+#include <list>
+#include <vector>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "SharedBuffer.hpp"
+
+// Server-wide cache of fully serialized small static responses, keyed by
+// vhost and mapped filesystem path. Responses are shared with the output
+// queues sending them, so eviction never invalidates bytes in flight. Entries are re-validated with stat()
+// at most every 'revalidate' seconds and evicted LRU-first over budget.
+class StaticCache {
+public:
+    struct Entry {
+        SharedBuffer    *response;  // Head (minus Connection and the blank line), then body
+        size_t          head_size;
+        std::string file_path;  // File actually served (may be a directory index)
+        time_t      mtime;
+        off_t       size;
+        ino_t       inode;
+        std::string sidecar_path; // .gz / .br the body was read from, empty for file_path
+        time_t      sidecar_mtime;
+        off_t       sidecar_size;
+        ino_t       sidecar_inode;
+        std::vector<std::string> skipped_sidecars; // A fresh one appearing changes the body
+        time_t      checked_at;
+        std::string etag;
+        std::string validators; // ETag, Last-Modified and Vary lines, for 304s
+    };
+
+private:
+    typedef std::list<std::string> LruList;
+    struct Slot {
+        Entry               entry;
+        LruList::iterator   lru;
+    };
+    typedef std::map<std::string, Slot> EntryMap;
+
+    EntryMap    _entries;
+    LruList     _lru;           // Front is the most recently used key
+    size_t      _bytes;
+    size_t      _max_bytes;
+    size_t      _max_file_size;
+    time_t      _revalidate;
+
+    void    _evict(EntryMap::iterator it);
+    static bool _still_valid(const Entry &entry);
+
+    StaticCache(const StaticCache &);
+    StaticCache &operator=(const StaticCache &);
+
+public:
+    StaticCache();
+    ~StaticCache();
+
+    void    configure(size_t max_bytes, size_t max_file_size, time_t revalidate);
+    bool    enabled() const { return _max_bytes > 0; }
+    bool    fits(off_t size) const;
+
+    // Returns NULL on a miss or when the file changed on disk
+    const Entry*    lookup(const std::string &key);
+    // Returns the new entry, or NULL when it does not fit
+    const Entry*    store(const std::string &key, const std::string &header, const std::string &body,
+                          const std::string &file_path, const struct stat &st,
+                          const std::string &sidecar_path, const struct stat &sidecar_st,
+                          const std::vector<std::string> &skipped_sidecars,
+                          const std::string &etag, const std::string &validators);
+    void            invalidate(const std::string &key);
+
+    size_t  size_bytes() const { return _bytes; }
+    size_t  entry_count() const { return _entries.size(); }
+};
+
+#endif
@@ -12,19 +12,188 @@
 
  
 #include "Client.hpp"
+#include <cerrno>
+#include <algorithm>
+
+const size_t Client::kMaxRecycledBuffer;
+const size_t Client::kMinRecvWindow;
   
-Client::Client(int socket_fd, int listen_port) : 
+Client::Client(int socket_fd, int listener_id, int listen_port) :
         fd(socket_fd),
+        listener_id(listener_id),
         listen_port(listen_port),
         cgi_pipe_fd(-1), 
         cgi_pid(-1), 
+        cgi_output_bytes(0),
+        cgi_queue(NULL),
+        cgi_stdin_fd(-1),
+        cgi_input_fd(-1),
+        cgi_input_offset(0),
+        cgi_input_size(0),
+        fastcgi(NULL),
+        cgi_paused(false),
+        cache_role(CACHE_NONE),
+        cache_ttl(0),
         state(STATE_READING_REQUEST),
-        last_activity(time(NULL)),
+        header_scan_pos(0),
+        gzip_fd(-1),
+        gzip_offset(0),
+        gzip_size(0),
         header_parsed(false),
         request_complete(false),
         chunked(false),
         content_length(0),
         header_end(0),
-        chunk_parse_pos(0),
         max_body_size(0),
-        config_resolved(false) {}
+        config_resolved(false),
+        request_end(0),
+        requests_served(0),
+        close_after_write(false),
+        body_sink_fd(-1),
+        body_received(0),
+        body_buffer_size(0),
+        body_write_failed(false),
+        config(NULL),
+        timeout_kind(TIMEOUT_NONE),
+        recv_window(kMinRecvWindow),
+        recv_calls(0),
+        recv_bytes(0) {
+    timer.id = socket_fd;
+}
+
+Client::~Client() {
+    discard_body_sink();
+    close_gzip_body();
+}
+
+void Client::discard_body_sink() {
+    if (body_sink_fd != -1) {
+        close(body_sink_fd);
+        body_sink_fd = -1;
+    }
+    if (!body_sink_path.empty()) {
+        unlink(body_sink_path.c_str());
+        body_sink_path.clear();
+    }
+}
+
+void Client::close_gzip_body() {
+    if (gzip_fd != -1) {
+        close(gzip_fd);
+        gzip_fd = -1;
+    }
+    gzip.reset();
+    gzip_offset = 0;
+    gzip_size = 0;
+}
+
+// Returns the object to its just-constructed state for a new connection,
+// keeping buffer capacity up to kMaxRecycledBuffer so steady-state
+// connection churn allocates nothing.
+void Client::reuse(int socket_fd, int listener, int port) {
+    recycle_buffer(request_buffer);
+    recycle_buffer(decoded_body);
+    output.clear();
+    close_gzip_body();
+    request_end = 0;
+    begin_next_request();
+    fd = socket_fd;
+    listener_id = listener;
+    listen_port = port;
+    cgi_pipe_fd = -1;
+    cgi_pid = -1;
+    cgi_output_bytes = 0;
+    cgi_queue = NULL;
+    cgi_stdin_fd = -1;
+    cgi_input_fd = -1;
+    recycle_buffer(cgi_input);
+    cgi_input_offset = 0;
+    cgi_input_size = 0;
+    fastcgi = NULL;
+    cgi_response.reset(false, false, false);
+    cgi_paused = false;
+    cache_role = CACHE_NONE;
+    cache_key.clear();
+    cache_ttl = 0;
+    state = STATE_READING_REQUEST;
+    requests_served = 0;
+    close_after_write = false;
+    body_buffer_size = 0;
+    config = NULL;
+    timeout_kind = TIMEOUT_NONE;
+    timer.id = socket_fd;
+    recv_window = kMinRecvWindow;
+    recv_calls = 0;
+    recv_bytes = 0;
+}
+
+void Client::record_read(size_t bytes, size_t max_window) {
+    ++recv_calls;
+    recv_bytes += bytes;
+    if (bytes == recv_window && recv_window < max_window) {
+        recv_window = std::min(recv_window * 2, max_window);
+    } else if (bytes < recv_window / 4 && recv_window > kMinRecvWindow) {
+        recv_window = std::max(recv_window / 2, kMinRecvWindow);
+    }
+}
+
+void Client::recycle_buffer(std::string &buffer) {
+    if (buffer.capacity() > kMaxRecycledBuffer) {
+        std::string().swap(buffer);
+    } else {
+        buffer.clear();
+    }
+}
+
+size_t Client::memory_bytes() const {
+    return sizeof(Client) + request_buffer.capacity() + decoded_body.capacity() + cgi_input.capacity()
+        + output.memory_bytes();
+}
+
+void Client::begin_next_request() {
+    request_buffer.erase(0, request_end);
+    request.reset();
+    header_scan_pos = 0;
+    header_parsed = false;
+    request_complete = false;
+    chunked = false;
+    content_length = 0;
+    header_end = 0;
+    chunk_decoder.reset();
+    decoded_body.clear();
+    max_body_size = 0;
+    config_resolved = false;
+    request_end = 0;
+    body_received = 0;
+    body_write_failed = false;
+    discard_body_sink();
+}
+
+bool Client::write_body_sink(const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(body_sink_fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        len -= written;
+    }
+    return true;
+}
+
+bool Client::write_body(const char *data, size_t len) {
+    body_received += len;
+    if (max_body_size > 0 && body_received > max_body_size) {
+        return false;
+    }
+    decoded_body.append(data, len);
+    if (body_sink_fd != -1 && decoded_body.size() >= body_buffer_size) {
+        if (!write_body_sink(decoded_body.data(), decoded_body.size())) {
+            body_write_failed = true;
+            return false;
+        }
+        decoded_body.clear();
+    }
+    return true;
+}
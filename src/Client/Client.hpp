@@ -17,6 +17,15 @@
 #include <string>
 #include <ctime>
 #include <unistd.h> // For pid_t
+#include "Request.hpp"
+#include "ChunkedDecoder.hpp"
+#include "OutputQueue.hpp"
+#include "CgiResponse.hpp"
+#include "TimerWheel.hpp"
+#include "Config.hpp"
+#include "GzipEncoder.hpp"
+
+struct FastCgiRequest;
 
 enum e_state {
     STATE_READING_REQUEST,
@@ -27,28 +36,102 @@ enum e_state {
     STATE_ERROR
 };
 
-class Client {
+// Which deadline the client's timer currently stands for
+enum e_timeout {
+    TIMEOUT_NONE,
+    TIMEOUT_HEADER,     // Whole header, from its first byte
+    TIMEOUT_BODY,       // Between two reads of the body
+    TIMEOUT_SEND,       // Between two successful sends
+    TIMEOUT_KEEPALIVE,  // Idle between requests
+    TIMEOUT_CGI,        // Script runtime
+    TIMEOUT_QUEUE       // Waiting for a cgi_max_concurrent slot
+};
+
+// Part a client plays in cgi_cache collapsed forwarding
+enum e_cache_role {
+    CACHE_NONE,
+    CACHE_FILLING,      // Its script's response will be stored
+    CACHE_WAITING       // Replays its request once the fill ends
+};
+
+class Client : public BodySink {
 public:
+    static const size_t kMaxRecycledBuffer = 64 * 1024;
+    static const size_t kMinRecvWindow = 4096;
+
     int             fd;
+    int             listener_id;   // Index of the accepting listener in the Server
     int             listen_port;
     int             cgi_pipe_fd;   // Read-end of the pipe from the CGI child
-    pid_t           cgi_pid;       // Child process ID for waitpid()
+    pid_t           cgi_pid;       // Child process ID, matched by the reaper
+    size_t          cgi_output_bytes; // Printed so far, for cgi_max_output
+    const RouteConfig *cgi_queue;  // Location whose CGI queue the request waits in
+    int             cgi_stdin_fd;  // Write-end of the script's stdin while the body is fed
+    int             cgi_input_fd;  // Spooled body being fed, read with pread()
+    std::string     cgi_input;     // In-memory body being fed otherwise
+    off_t           cgi_input_offset;
+    off_t           cgi_input_size;
+    FastCgiRequest  *fastcgi;      // In-flight request on a fastcgi_pass backend
+    CgiResponse     cgi_response;  // Script output to HTTP, CGI and FastCGI alike
+    bool            cgi_paused;    // Script output not read while the socket is backed up
+    e_cache_role    cache_role;
+    std::string     cache_key;     // Key being filled or waited on
+    time_t          cache_ttl;     // Location's cgi_cache time for the fill
     e_state         state;
     std::string     request_buffer;
-    std::string     response_buffer;
-    time_t          last_activity; // For handling timeouts
+    Request         request;           // Offsets into request_buffer, parsed once
+    size_t          header_scan_pos;   // How far "\r\n\r\n" has been searched
+    OutputQueue     output;            // Queued responses, headers and bodies
+    int             gzip_fd;           // Static file compressed as the socket drains
+    off_t           gzip_offset;
+    off_t           gzip_size;
+    GzipEncoder     gzip;
     bool            header_parsed;
     bool            request_complete;
     bool            chunked;
     size_t          content_length;
     size_t          header_end;
-    size_t          chunk_parse_pos;
-    std::string     decoded_body;
+    ChunkedDecoder  chunk_decoder;
+    std::string     decoded_body;      // Chunked payload not yet handed to the sink
     size_t          max_body_size;
     bool            config_resolved;
+    size_t          request_end;       // End of the current request in request_buffer
+    size_t          requests_served;   // On this connection, for keepalive_requests
+    bool            close_after_write; // Set once any queued response is the last one
+    int             body_sink_fd;      // Temporary upload file the body is spooled to
+    std::string     body_sink_path;
+    size_t          body_received;     // Body bytes consumed so far (decoded for chunked)
+    size_t          body_buffer_size;  // client_body_buffer_size of the selected server
+    bool            body_write_failed;
+    const ServerConfig *config;        // Listener default until a Host selects a vhost
+    TimerNode       timer;
+    e_timeout       timeout_kind;
+    size_t          recv_window;       // Bytes asked of the next recv(), adapts to traffic
+    size_t          recv_calls;        // Per connection, logged on close for tuning
+    size_t          recv_bytes;
 
     // Constructor to initialize everything to safe defaults
-    Client(int socket_fd, int listen_port);
+    Client(int socket_fd, int listener_id, int listen_port);
+    ~Client();
+
+    void    reuse(int socket_fd, int listener_id, int listen_port);
+    static void recycle_buffer(std::string &buffer);
+    // Doubles the window after a full read, halves it after a mostly empty one
+    void    record_read(size_t bytes, size_t max_window);
+    // Heap held by this connection, for the pool's statistics
+    size_t  memory_bytes() const;
+
+    // Drops the current request from request_buffer and resets the parser,
+    // keeping any pipelined bytes that follow it
+    void    begin_next_request();
+    // Closes and unlinks an unfinished upload
+    void    discard_body_sink();
+    // Ends the compressed file body, finished or not
+    void    close_gzip_body();
+    bool    write_body_sink(const char *data, size_t len);
+    // Decoded chunked payload: buffered, and flushed to the upload file in
+    // client_body_buffer_size pieces when one is open
+    bool    write_body(const char *data, size_t len);
 };
 
 #endif
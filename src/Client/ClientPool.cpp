@@ -0,0 +1,107 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ClientPool.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "ClientPool.hpp"
+#include <sys/resource.h>
+
+static const size_t kMaxTableSize = 65536;
+
+ClientPool::ClientPool() : _live(0), _max_free(0) {}
+
+ClientPool::~ClientPool() {
+    clear();
+}
+
+void ClientPool::reserve(size_t max_free) {
+    _max_free = max_free;
+    struct rlimit limit;
+    size_t size = 1024;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        size = static_cast<size_t>(limit.rlim_cur);
+    }
+    if (size > kMaxTableSize) {
+        size = kMaxTableSize;
+    }
+    if (_by_fd.size() < size) {
+        _by_fd.resize(size, NULL);
+    }
+    _free.reserve(_max_free);
+}
+
+void ClientPool::_grow(int fd) {
+    if (static_cast<size_t>(fd) >= _by_fd.size()) {
+        _by_fd.resize(static_cast<size_t>(fd) * 2 + 1, NULL);
+    }
+}
+
+Client* ClientPool::acquire(int socket_fd, int listener_id, int listen_port) {
+    Client *c;
+    if (_free.empty()) {
+        c = new Client(socket_fd, listener_id, listen_port);
+    } else {
+        c = _free.back();
+        _free.pop_back();
+        c->reuse(socket_fd, listener_id, listen_port);
+    }
+    attach(socket_fd, c);
+    ++_live;
+    return c;
+}
+
+void ClientPool::release(Client *c) {
+    detach(c->fd);
+    --_live;
+    if (_free.size() < _max_free) {
+        // Drops upload files and queued segments now, keeps the buffers
+        c->reuse(-1, -1, 0);
+        _free.push_back(c);
+    } else {
+        delete c;
+    }
+}
+
+void ClientPool::attach(int fd, Client *c) {
+    _grow(fd);
+    _by_fd[fd] = c;
+}
+
+void ClientPool::detach(int fd) {
+    if (fd >= 0 && static_cast<size_t>(fd) < _by_fd.size()) {
+        _by_fd[fd] = NULL;
+    }
+}
+
+size_t ClientPool::memory_bytes() const {
+    size_t total = 0;
+    for (size_t fd = 0; fd < _by_fd.size(); ++fd) {
+        const Client *c = _by_fd[fd];
+        if (c && static_cast<size_t>(c->fd) == fd) {
+            total += c->memory_bytes();
+        }
+    }
+    return total;
+}
+
+void ClientPool::clear() {
+    for (size_t fd = 0; fd < _by_fd.size(); ++fd) {
+        Client *c = _by_fd[fd];
+        if (c && static_cast<size_t>(c->fd) == fd) {
+            delete c;
+        }
+        _by_fd[fd] = NULL;
+    }
+    for (size_t i = 0; i < _free.size(); ++i) {
+        delete _free[i];
+    }
+    _free.clear();
+    _live = 0;
+}
@@ -0,0 +1,67 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ClientPool.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CLIENT_POOL_HPP
+#define CLIENT_POOL_HPP
+
+#include <vector>
+#include <cstddef>
+#include "Client.hpp"
+
+// fd-indexed connection table plus a free list of Client objects. Socket
+// and CGI pipe fds both map to their owning Client, so dispatch is a single
+// vector index; closed connections go back to the free list with their
+// buffers instead of being deleted.
+class ClientPool {
+private:
+    std::vector<Client*>    _by_fd;     // Key: client socket or CGI pipe fd
+    std::vector<Client*>    _free;
+    size_t                  _live;
+    size_t                  _max_free;  // Idle objects kept around
+
+    ClientPool(const ClientPool &);
+    ClientPool &operator=(const ClientPool &);
+
+    void    _grow(int fd);
+
+public:
+    ClientPool();
+    ~ClientPool();
+
+    // Sizes the table for the process fd limit and keeps up to 'max_free'
+    // released objects
+    void    reserve(size_t max_free);
+
+    Client* acquire(int socket_fd, int listener_id, int listen_port);
+    // Unmaps the socket; the caller has already detached any CGI pipe
+    void    release(Client *c);
+
+    void    attach(int fd, Client *c);
+    void    detach(int fd);
+    Client* find(int fd) const {
+        return fd >= 0 && static_cast<size_t>(fd) < _by_fd.size() ? _by_fd[fd] : NULL;
+    }
+    // The client whose socket is 'fd', NULL for pipes and unused slots
+    Client* client_at(int fd) const {
+        Client *c = find(fd);
+        return c && c->fd == fd ? c : NULL;
+    }
+    int     table_size() const { return static_cast<int>(_by_fd.size()); }
+
+    size_t  live() const { return _live; }
+    size_t  pooled() const { return _free.size(); }
+    // Heap held by live connections; walks the table, meant for reporting
+    size_t  memory_bytes() const;
+    void    clear();
+};
+
+#endif
@@ -0,0 +1,237 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   OutputQueue.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "OutputQueue.hpp"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+static const size_t kMaxIovecs = 64;
+static const off_t  kMaxFileChunk = 1024 * 1024; // Per wakeup, so one download cannot starve the loop
+static const size_t kMergeLimit = 64 * 1024;     // Largest owned segment append_copy grows
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+
+OutputQueue::OutputQueue() : _cursor(0), _bytes(0) {}
+
+OutputQueue::~OutputQueue() {
+    clear();
+}
+
+OutputQueue::Segment &OutputQueue::_push(e_segment_type type) {
+    _segments.push_back(Segment());
+    Segment &segment = _segments.back();
+    segment.type = type;
+    segment.data = NULL;
+    segment.size = 0;
+    segment.shared = NULL;
+    segment.fd = -1;
+    segment.offset = 0;
+    return segment;
+}
+
+void OutputQueue::_pop_front() {
+    Segment &segment = _segments.front();
+    if (segment.type == SEGMENT_FILE) {
+        close(segment.fd);
+    } else {
+        _bytes -= _segment_size(segment) - _cursor;
+    }
+    if (segment.type == SEGMENT_SHARED) {
+        segment.shared->release();
+    }
+    _segments.pop_front();
+    _cursor = 0;
+}
+
+size_t OutputQueue::_segment_size(const Segment &segment) const {
+    return segment.type == SEGMENT_OWNED ? segment.owned.size() : segment.size;
+}
+
+const char *OutputQueue::_segment_data(const Segment &segment) const {
+    return segment.type == SEGMENT_OWNED ? segment.owned.data() : segment.data;
+}
+
+void OutputQueue::append_static(const char *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    Segment &segment = _push(SEGMENT_STATIC);
+    segment.data = data;
+    segment.size = len;
+    _bytes += len;
+}
+
+void OutputQueue::append_static(const char *literal) {
+    append_static(literal, std::strlen(literal));
+}
+
+void OutputQueue::append_owned(std::string &data) {
+    if (data.empty()) {
+        return;
+    }
+    _bytes += data.size();
+    _push(SEGMENT_OWNED).owned.swap(data);
+}
+
+void OutputQueue::append_copy(const char *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    // Merging into the front segment once part of it went out would keep
+    // its sent prefix alive for as long as the peer lags, so that segment
+    // and any segment past kMergeLimit start a new one instead
+    if (_segments.empty() || _segments.back().type != SEGMENT_OWNED
+            || (_segments.size() == 1 && _cursor > 0)
+            || _segments.back().owned.size() + len > kMergeLimit) {
+        _push(SEGMENT_OWNED);
+    }
+    _segments.back().owned.append(data, len);
+    _bytes += len;
+}
+
+void OutputQueue::append_shared(SharedBuffer *buffer, size_t offset, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    buffer->retain();
+    Segment &segment = _push(SEGMENT_SHARED);
+    segment.shared = buffer;
+    segment.data = buffer->data().data() + offset;
+    segment.size = len;
+    _bytes += len;
+}
+
+void OutputQueue::append_file(int fd, off_t offset, off_t len) {
+    Segment &segment = _push(SEGMENT_FILE);
+    segment.fd = fd;
+    segment.offset = offset;
+    segment.size = static_cast<size_t>(len);
+}
+
+bool OutputQueue::has_file() const {
+    for (std::deque<Segment>::const_iterator it = _segments.begin(); it != _segments.end(); ++it) {
+        if (it->type == SEGMENT_FILE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void OutputQueue::clear() {
+    while (!_segments.empty()) {
+        _pop_front();
+    }
+}
+
+// Gathers the in-memory segments up to the next file range into one
+// sendmsg(). MSG_MORE holds a header back until the file body follows.
+ssize_t OutputQueue::_send_memory(int socket_fd) {
+    struct iovec iov[kMaxIovecs];
+    size_t count = 0;
+    size_t skip = _cursor;
+    bool file_follows = false;
+    for (std::deque<Segment>::iterator it = _segments.begin(); it != _segments.end() && count < kMaxIovecs; ++it) {
+        if (it->type == SEGMENT_FILE) {
+            file_follows = true;
+            break;
+        }
+        iov[count].iov_base = const_cast<char *>(_segment_data(*it) + skip);
+        iov[count].iov_len = _segment_size(*it) - skip;
+        skip = 0;
+        ++count;
+    }
+
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    ssize_t sent = sendmsg(socket_fd, &msg, MSG_NOSIGNAL | (file_follows ? MSG_MORE : 0));
+    if (sent <= 0) {
+        return sent;
+    }
+
+    size_t left = static_cast<size_t>(sent);
+    while (left > 0) {
+        size_t in_front = _segment_size(_segments.front()) - _cursor;
+        if (left < in_front) {
+            _cursor += left;
+            _bytes -= left;
+            break;
+        }
+        left -= in_front;
+        _pop_front();
+    }
+    return sent;
+}
+
+ssize_t OutputQueue::_send_file(int socket_fd) {
+    Segment &segment = _segments.front();
+    off_t count = static_cast<off_t>(segment.size) < kMaxFileChunk ? static_cast<off_t>(segment.size) : kMaxFileChunk;
+    ssize_t sent = 0;
+    if (count > 0) {
+#ifdef __linux__
+        sent = sendfile(socket_fd, segment.fd, &segment.offset, static_cast<size_t>(count));
+#else
+        char buffer[65536];
+        if (count > static_cast<off_t>(sizeof(buffer))) {
+            count = sizeof(buffer);
+        }
+        ssize_t bytes_read = pread(segment.fd, buffer, count, segment.offset);
+        sent = bytes_read > 0 ? send(socket_fd, buffer, bytes_read, MSG_NOSIGNAL) : bytes_read;
+        if (sent > 0) {
+            segment.offset += sent;
+        }
+#endif
+        if (sent == 0) {
+            errno = EIO; // File shrank under us: the promised Content-Length cannot be met
+            return -1;
+        }
+        if (sent < 0) {
+            return sent;
+        }
+        segment.size -= static_cast<size_t>(sent);
+    }
+    if (segment.size == 0) {
+        _pop_front();
+    }
+    return sent;
+}
+
+OutputQueue::e_send_result OutputQueue::send_to(int socket_fd) {
+    while (!_segments.empty()) {
+        bool file = _segments.front().type == SEGMENT_FILE;
+        size_t queued = _segments.size();
+        ssize_t sent = file ? _send_file(socket_fd) : _send_memory(socket_fd);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return SEND_AGAIN;
+            }
+            return SEND_ERROR;
+        }
+        // A file range still going, or a short write, means the socket is busy
+        if (file ? _segments.size() == queued : (sent == 0 || _cursor > 0)) {
+            return SEND_AGAIN;
+        }
+    }
+    return SEND_DONE;
+}
@@ -0,0 +1,86 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   OutputQueue.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef OUTPUT_QUEUE_HPP
+#define OUTPUT_QUEUE_HPP
+
+#include <string>
+#include <deque>
+#include <sys/types.h>
+#include "SharedBuffer.hpp"
+
+// Per-connection list of pending output. Responses are queued as segments
+// pointing at where the bytes already live and drained with one sendmsg()
+// per wakeup; a cursor into the front segment replaces erasing sent bytes.
+class OutputQueue {
+public:
+    enum e_send_result {
+        SEND_DONE,          // Queue is empty
+        SEND_AGAIN,         // Socket is full, wait for the next EVENT_WRITE
+        SEND_ERROR
+    };
+
+private:
+    enum e_segment_type {
+        SEGMENT_STATIC,     // Bytes with static storage, e.g. literals
+        SEGMENT_OWNED,      // Bytes held by the segment itself
+        SEGMENT_SHARED,     // Slice of a SharedBuffer the segment references
+        SEGMENT_FILE        // Range of an open file, owned by the segment
+    };
+
+    struct Segment {
+        e_segment_type  type;
+        const char      *data;      // STATIC and SHARED
+        size_t          size;
+        std::string     owned;
+        SharedBuffer    *shared;
+        int             fd;
+        off_t           offset;     // FILE: next byte to send
+    };
+
+    std::deque<Segment> _segments;
+    size_t              _cursor;    // Bytes of the front segment already sent
+    size_t              _bytes;     // In-memory bytes still queued
+
+    Segment         &_push(e_segment_type type);
+    void            _pop_front();
+    size_t          _segment_size(const Segment &segment) const;
+    const char      *_segment_data(const Segment &segment) const;
+    ssize_t         _send_memory(int socket_fd);
+    ssize_t         _send_file(int socket_fd);
+
+    OutputQueue(const OutputQueue &);
+    OutputQueue &operator=(const OutputQueue &);
+
+public:
+    OutputQueue();
+    ~OutputQueue();
+
+    void    append_static(const char *data, size_t len);
+    void    append_static(const char *literal);
+    // Takes the contents of 'data', leaving it empty
+    void    append_owned(std::string &data);
+    // Copies, merging into the last owned segment when possible
+    void    append_copy(const char *data, size_t len);
+    void    append_shared(SharedBuffer *buffer, size_t offset, size_t len);
+    // The queue closes 'fd' once the range is sent or the queue is cleared
+    void    append_file(int fd, off_t offset, off_t len);
+
+    e_send_result   send_to(int socket_fd);
+    void            clear();
+
+    bool    empty() const { return _segments.empty(); }
+    bool    has_file() const;
+    size_t  memory_bytes() const { return _bytes; }
+};
+
+#endif
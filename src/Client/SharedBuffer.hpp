@@ -0,0 +1,38 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   SharedBuffer.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef SHARED_BUFFER_HPP
+#define SHARED_BUFFER_HPP
+
+#include <string>
+
+// Reference-counted immutable bytes, so a cached response can sit in many
+// output queues without being copied. Workers are single threaded, so a
+// plain counter is enough.
+class SharedBuffer {
+private:
+    std::string _data;
+    size_t      _refs;
+
+    SharedBuffer(const SharedBuffer &);
+    SharedBuffer &operator=(const SharedBuffer &);
+
+public:
+    // The new buffer holds one reference for the caller
+    explicit SharedBuffer(const std::string &data) : _data(data), _refs(1) {}
+
+    const std::string   &data() const { return _data; }
+    void                retain() { ++_refs; }
+    void                release() { if (--_refs == 0) delete this; }
+};
+
+#endif
@@ -16,6 +16,8 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <ctime>
+#include <sys/socket.h>
 
 struct RouteConfig {
     std::string                 path;
@@ -26,6 +28,15 @@ struct RouteConfig {
     std::string                 upload_dir;
     std::vector<std::string>    allowed_methods;
     std::vector<std::string>    cgi_extensions;
+    std::map<std::string, std::string> cgi_interpreters; // Key: extension, value: absolute path
+    std::string                 fastcgi_pass;   // "unix:/path" or "host:port"
+    struct sockaddr_storage     fastcgi_addr;   // fastcgi_pass, resolved at load time
+    socklen_t                   fastcgi_addr_len;
+    time_t                      cgi_cache_ttl;  // Seconds, 0 disables the micro-cache
+    std::vector<std::string>    cgi_cache_key_headers; // Request headers the cache key varies on
+    size_t                      cgi_max_concurrent; // Scripts running at once, 0 for no limit
+    size_t                      cgi_queue_size;     // Requests waiting for a slot before 503s
+    time_t                      cgi_queue_timeout;  // Seconds a request may wait for a slot
     int                         redirect_code;
     std::string                 redirect_target;
     bool                        max_body_size_set;
@@ -34,29 +45,112 @@ struct RouteConfig {
     RouteConfig()
         : autoindex_set(false),
           autoindex(false),
+          fastcgi_addr(),
+          fastcgi_addr_len(0),
+          cgi_cache_ttl(0),
+          cgi_max_concurrent(0),
+          cgi_queue_size(64),
+          cgi_queue_timeout(10),
           redirect_code(0),
           max_body_size_set(false),
           max_body_size(0) {}
 };
 
+class RouteTable;
+
+// Socket options from a listen directive. Server blocks sharing an address
+// share one socket, so the first block that names the address sets them.
+struct ListenOptions {
+    int     backlog;
+    bool    deferred;   // TCP_DEFER_ACCEPT: wake up only once the request has data
+    int     fastopen;   // TCP_FASTOPEN queue length, 0 disables
+    int     rcvbuf;     // SO_RCVBUF, 0 keeps the system default
+    int     sndbuf;     // SO_SNDBUF, 0 keeps the system default
+    bool    nodelay;    // TCP_NODELAY on accepted sockets
+
+    ListenOptions()
+        : backlog(511), deferred(false), fastopen(0), rcvbuf(0), sndbuf(0), nodelay(true) {}
+};
+
 struct ServerConfig {
     int                         port;
     std::string                 host;
-    std::string                 server_name;
+    std::string                 server_name;         // First of server_names
+    std::vector<std::string>    server_names;        // Exact names and *.suffix wildcards
     std::string                 root;
     std::string                 index;
     bool                        autoindex;
     std::string                 upload_dir;
     std::vector<std::string>    allowed_methods;
     std::vector<std::string>    cgi_extensions;
+    std::map<std::string, std::string> cgi_interpreters;
     size_t                      max_body_size;
+    size_t                      client_body_buffer_size; // Upload bytes held before hitting disk
     std::map<int, std::string>  error_pages;
     std::vector<RouteConfig>    routes;
+    time_t                      keepalive_timeout;   // Seconds, 0 disables keep-alive
+    size_t                      keepalive_requests;  // Per connection
+    time_t                      client_header_timeout;  // Seconds for the whole header
+    time_t                      client_body_timeout;    // Seconds between body reads
+    time_t                      send_timeout;           // Seconds between successful sends
+    time_t                      cgi_timeout;            // Seconds a script may run
+    size_t                      cgi_max_output;         // Bytes a script may print, 0 for no limit
+    bool                        gzip_static;         // Serve fresh file.br / file.gz sidecars
+    bool                        gzip;                // Compress files on the fly, once when cached
+    size_t                      gzip_min_length;     // Smaller files are not worth compressing
+    std::vector<std::string>    gzip_types;          // Content types compressed on the fly
+    ListenOptions               listen_options;
+    const RouteTable            *route_table;        // Compiled by the Server, shared by copies
 
     ServerConfig()
         : port(8080),
           autoindex(true),
-          max_body_size(1024 * 1024) {}
+          max_body_size(1024 * 1024),
+          client_body_buffer_size(16 * 1024),
+          keepalive_timeout(15),
+          keepalive_requests(100),
+          client_header_timeout(30),
+          client_body_timeout(30),
+          send_timeout(30),
+          cgi_timeout(30),
+          cgi_max_output(0),
+          gzip_static(false),
+          gzip(false),
+          gzip_min_length(1024),
+          route_table(NULL) {
+        gzip_types.push_back("text/html");
+        gzip_types.push_back("text/css");
+        gzip_types.push_back("text/plain");
+        gzip_types.push_back("application/javascript");
+        gzip_types.push_back("application/json");
+        gzip_types.push_back("image/svg+xml");
+    }
+};
+
+// Directives that live outside of any server block
+struct GlobalConfig {
+    std::string                 event_backend;
+    int                         worker_processes;   // 0 means one per online CPU
+    bool                        worker_cpu_affinity;
+    size_t                      static_cache_max_bytes;      // 0 disables the cache
+    size_t                      static_cache_max_file_size;
+    time_t                      static_cache_valid;          // Seconds between stat() checks
+    size_t                      client_receive_buffer_max;   // Largest single recv() per connection
+    size_t                      client_max_header_size;      // Request line and headers, 431 above
+    size_t                      cgi_cache_max_bytes;         // 0 disables cgi_cache everywhere
+    size_t                      cgi_cache_max_entry_size;
+
+    GlobalConfig()
+        : event_backend("epoll"),
+          worker_processes(1),
+          worker_cpu_affinity(false),
+          static_cache_max_bytes(8 * 1024 * 1024),
+          static_cache_max_file_size(64 * 1024),
+          static_cache_valid(1),
+          client_receive_buffer_max(64 * 1024),
+          client_max_header_size(32 * 1024),
+          cgi_cache_max_bytes(8 * 1024 * 1024),
+          cgi_cache_max_entry_size(1024 * 1024) {}
 };
 
 #endif
@@ -11,6 +11,8 @@
 /* ************************************************************************** */
 
 #include "ConfigParser.hpp"
+#include "FastCgiClient.hpp"
+#include "GzipEncoder.hpp"
 #include <cstdlib>
 
 static std::vector<std::string> tokenize_config(const std::string &content) {
@@ -56,6 +58,32 @@ static void apply_default_methods(std::vector<std::string> &methods) {
     }
 }
 
+// "cgi_ext .py /usr/bin/python3 .cgi": an absolute path after an extension
+// runs scripts with that extension through it, the others are executed
+static void parse_cgi_ext(const std::vector<std::string> &tokens, size_t &i, std::vector<std::string> &extensions,
+                          std::map<std::string, std::string> &interpreters) {
+    extensions.clear();
+    interpreters.clear();
+    while (i < tokens.size() && tokens[i] != ";") {
+        const std::string &token = tokens[i++];
+        if (token[0] != '/') {
+            extensions.push_back(token);
+        } else if (extensions.empty()) {
+            throw std::runtime_error("cgi_ext interpreter without an extension: " + token);
+        } else {
+            interpreters[extensions.back()] = token;
+        }
+    }
+}
+
+static time_t parse_timeout(const std::string &key, const std::string &value) {
+    time_t seconds = static_cast<time_t>(std::atol(value.c_str()));
+    if (seconds <= 0) {
+        throw std::runtime_error(key + " must be positive");
+    }
+    return seconds;
+}
+
 static RouteConfig parse_location_block(const std::vector<std::string> &tokens, size_t &i) {
     RouteConfig route;
     if (i >= tokens.size()) {
@@ -84,10 +112,32 @@ static RouteConfig parse_location_block(const std::vector<std::string> &tokens,
                 route.allowed_methods.push_back(tokens[i++]);
             }
         } else if (key == "cgi_ext") {
-            route.cgi_extensions.clear();
+            parse_cgi_ext(tokens, i, route.cgi_extensions, route.cgi_interpreters);
+        } else if (key == "fastcgi_pass") {
+            route.fastcgi_pass = tokens[i++];
+            if (!FastCgiClient::valid_address(route.fastcgi_pass)) {
+                throw std::runtime_error("Invalid fastcgi_pass address: " + route.fastcgi_pass);
+            }
+            if (!FastCgiClient::resolve(route.fastcgi_pass, route.fastcgi_addr, route.fastcgi_addr_len)) {
+                throw std::runtime_error("Could not resolve fastcgi_pass address: " + route.fastcgi_pass);
+            }
+        } else if (key == "cgi_cache") {
+            // "cgi_cache off;" or "cgi_cache <seconds> [header ...];"
+            std::string value = tokens[i++];
+            route.cgi_cache_ttl = (value == "off") ? 0 : static_cast<time_t>(std::atol(value.c_str()));
+            if (value != "off" && route.cgi_cache_ttl <= 0) {
+                throw std::runtime_error("Invalid cgi_cache time: " + value);
+            }
+            route.cgi_cache_key_headers.clear();
             while (i < tokens.size() && tokens[i] != ";") {
-                route.cgi_extensions.push_back(tokens[i++]);
+                route.cgi_cache_key_headers.push_back(tokens[i++]);
             }
+        } else if (key == "cgi_max_concurrent") {
+            route.cgi_max_concurrent = static_cast<size_t>(std::strtoul(tokens[i++].c_str(), NULL, 10));
+        } else if (key == "cgi_queue_size") {
+            route.cgi_queue_size = static_cast<size_t>(std::strtoul(tokens[i++].c_str(), NULL, 10));
+        } else if (key == "cgi_queue_timeout") {
+            route.cgi_queue_timeout = parse_timeout(key, tokens[i++]);
         } else if (key == "return") {
             route.redirect_code = std::atoi(tokens[i++].c_str());
             route.redirect_target = tokens[i++];
@@ -106,6 +156,33 @@ static RouteConfig parse_location_block(const std::vector<std::string> &tokens,
     return route;
 }
 
+static int parse_listen_number(const std::string &option, size_t prefix) {
+    std::string value = option.substr(prefix);
+    char *end = NULL;
+    long number = std::strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || number < 0 || number > 0x7fffffff) {
+        throw std::runtime_error("Invalid listen parameter: " + option);
+    }
+    return static_cast<int>(number);
+}
+
+// One 'name' or 'name=value' parameter after the listen address
+static void parse_listen_option(const std::string &option, ListenOptions &options) {
+    if (option == "deferred") {
+        options.deferred = true;
+    } else if (option.compare(0, 8, "backlog=") == 0) {
+        options.backlog = parse_listen_number(option, 8);
+    } else if (option.compare(0, 9, "fastopen=") == 0) {
+        options.fastopen = parse_listen_number(option, 9);
+    } else if (option.compare(0, 7, "rcvbuf=") == 0) {
+        options.rcvbuf = parse_listen_number(option, 7);
+    } else if (option.compare(0, 7, "sndbuf=") == 0) {
+        options.sndbuf = parse_listen_number(option, 7);
+    } else {
+        throw std::runtime_error("Unknown listen parameter: " + option);
+    }
+}
+
 static ServerConfig parse_server_block(const std::vector<std::string> &tokens, size_t &i) {
     ServerConfig config;
     config.root = "./www";
@@ -120,9 +197,39 @@ static ServerConfig parse_server_block(const std::vector<std::string> &tokens, s
     while (i < tokens.size() && tokens[i] != "}") {
         std::string key = tokens[i++];
         if (key == "listen") {
-            config.port = std::atoi(tokens[i++].c_str());
+            std::string value = tokens[i++];
+            if (!value.empty() && value[0] == '[') {
+                // [IPv6 address]:port
+                size_t close = value.find("]:");
+                if (close == std::string::npos) {
+                    throw std::runtime_error("Invalid listen address: " + value);
+                }
+                config.host = value.substr(1, close - 1);
+                value = value.substr(close + 2);
+            } else {
+                size_t colon = value.rfind(':');
+                if (colon != std::string::npos) {
+                    config.host = value.substr(0, colon);
+                    value = value.substr(colon + 1);
+                }
+            }
+            config.port = std::atoi(value.c_str());
+            if (config.port <= 0 || config.port > 65535) {
+                throw std::runtime_error("Invalid listen port: " + value);
+            }
+            while (i < tokens.size() && tokens[i] != ";") {
+                parse_listen_option(tokens[i++], config.listen_options);
+            }
+        } else if (key == "tcp_nodelay") {
+            config.listen_options.nodelay = (tokens[i++] == "on");
+        } else if (key == "host") {
+            config.host = tokens[i++];
         } else if (key == "server_name") {
-            config.server_name = tokens[i++];
+            config.server_names.clear();
+            while (i < tokens.size() && tokens[i] != ";") {
+                config.server_names.push_back(tokens[i++]);
+            }
+            config.server_name = config.server_names.empty() ? "" : config.server_names[0];
         } else if (key == "root") {
             config.root = tokens[i++];
         } else if (key == "index") {
@@ -138,12 +245,43 @@ static ServerConfig parse_server_block(const std::vector<std::string> &tokens, s
                 config.allowed_methods.push_back(tokens[i++]);
             }
         } else if (key == "cgi_ext") {
-            config.cgi_extensions.clear();
-            while (i < tokens.size() && tokens[i] != ";") {
-                config.cgi_extensions.push_back(tokens[i++]);
-            }
+            parse_cgi_ext(tokens, i, config.cgi_extensions, config.cgi_interpreters);
         } else if (key == "client_max_body_size") {
             config.max_body_size = static_cast<size_t>(std::strtoul(tokens[i++].c_str(), NULL, 10));
+        } else if (key == "client_body_buffer_size") {
+            config.client_body_buffer_size = static_cast<size_t>(std::strtoul(tokens[i++].c_str(), NULL, 10));
+            if (config.client_body_buffer_size == 0) {
+                throw std::runtime_error("client_body_buffer_size must be positive");
+            }
+        } else if (key == "keepalive_timeout") {
+            config.keepalive_timeout = static_cast<time_t>(std::atol(tokens[i++].c_str()));
+        } else if (key == "keepalive_requests") {
+            config.keepalive_requests = static_cast<size_t>(std::strtoul(tokens[i++].c_str(), NULL, 10));
+        } else if (key == "client_header_timeout") {
+            config.client_header_timeout = parse_timeout(key, tokens[i++]);
+        } else if (key == "client_body_timeout") {
+            config.client_body_timeout = parse_timeout(key, tokens[i++]);
+        } else if (key == "send_timeout") {
+            config.send_timeout = parse_timeout(key, tokens[i++]);
+        } else if (key == "cgi_timeout") {
+            config.cgi_timeout = parse_timeout(key, tokens[i++]);
+        } else if (key == "cgi_max_output") {
+            config.cgi_max_output = static_cast<size_t>(std::strtoul(tokens[i++].c_str(), NULL, 10));
+        } else if (key == "gzip_static") {
+            config.gzip_static = (tokens[i++] == "on");
+        } else if (key == "gzip") {
+            config.gzip = (tokens[i++] == "on");
+            if (config.gzip && !GzipEncoder::available()) {
+                std::cerr << "gzip on ignored: built without zlib" << std::endl;
+                config.gzip = false;
+            }
+        } else if (key == "gzip_min_length") {
+            config.gzip_min_length = static_cast<size_t>(std::strtoul(tokens[i++].c_str(), NULL, 10));
+        } else if (key == "gzip_types") {
+            config.gzip_types.clear();
+            while (i < tokens.size() && tokens[i] != ";") {
+                config.gzip_types.push_back(tokens[i++]);
+            }
         } else if (key == "error_page") {
             int code = std::atoi(tokens[i++].c_str());
             std::string path_value = tokens[i++];
@@ -163,7 +301,76 @@ static ServerConfig parse_server_block(const std::vector<std::string> &tokens, s
     return config;
 }
 
+static void parse_events_block(const std::vector<std::string> &tokens, size_t &i, GlobalConfig &global) {
+    if (i >= tokens.size() || tokens[i] != "{") {
+        throw std::runtime_error("Expected '{' after events");
+    }
+    ++i;
+    while (i < tokens.size() && tokens[i] != "}") {
+        std::string key = tokens[i++];
+        if (key == "use") {
+            std::string value = tokens[i++];
+            if (value != "epoll" && value != "poll") {
+                throw std::runtime_error("Unknown event backend: " + value);
+            }
+            global.event_backend = value;
+        }
+        if (i < tokens.size() && tokens[i] == ";") {
+            ++i;
+        }
+    }
+    if (i < tokens.size() && tokens[i] == "}") {
+        ++i;
+    }
+}
+
+// Top-level 'key value;' directives. Returns false for unknown keys.
+static bool parse_global_directive(const std::vector<std::string> &tokens, size_t &i, GlobalConfig &global) {
+    const std::string &key = tokens[i];
+    const std::string &value = tokens[i + 1];
+    if (key == "worker_processes") {
+        global.worker_processes = (value == "auto") ? 0 : std::atoi(value.c_str());
+        if (value != "auto" && global.worker_processes < 1) {
+            throw std::runtime_error("Invalid worker_processes: " + value);
+        }
+    } else if (key == "worker_cpu_affinity") {
+        global.worker_cpu_affinity = (value == "auto" || value == "on");
+    } else if (key == "static_cache_max_bytes") {
+        global.static_cache_max_bytes = static_cast<size_t>(std::strtoul(value.c_str(), NULL, 10));
+    } else if (key == "static_cache_max_file_size") {
+        global.static_cache_max_file_size = static_cast<size_t>(std::strtoul(value.c_str(), NULL, 10));
+    } else if (key == "static_cache_valid") {
+        global.static_cache_valid = static_cast<time_t>(std::atol(value.c_str()));
+    } else if (key == "cgi_cache_max_bytes") {
+        global.cgi_cache_max_bytes = static_cast<size_t>(std::strtoul(value.c_str(), NULL, 10));
+    } else if (key == "cgi_cache_max_entry_size") {
+        global.cgi_cache_max_entry_size = static_cast<size_t>(std::strtoul(value.c_str(), NULL, 10));
+    } else if (key == "client_receive_buffer_max") {
+        global.client_receive_buffer_max = static_cast<size_t>(std::strtoul(value.c_str(), NULL, 10));
+        if (global.client_receive_buffer_max < 4096) {
+            throw std::runtime_error("client_receive_buffer_max must be at least 4096");
+        }
+    } else if (key == "client_max_header_size") {
+        global.client_max_header_size = static_cast<size_t>(std::strtoul(value.c_str(), NULL, 10));
+        if (global.client_max_header_size < 1024) {
+            throw std::runtime_error("client_max_header_size must be at least 1024");
+        }
+    } else {
+        return false;
+    }
+    i += 2;
+    if (i < tokens.size() && tokens[i] == ";") {
+        ++i;
+    }
+    return true;
+}
+
 std::vector<ServerConfig> ConfigParser::parse(const std::string& path) {
+    GlobalConfig global;
+    return parse(path, global);
+}
+
+std::vector<ServerConfig> ConfigParser::parse(const std::string& path, GlobalConfig &global) {
     std::ifstream file(path.c_str());
     if (!file.is_open()) {
         throw std::runtime_error("Could not open config file");
@@ -179,6 +386,11 @@ std::vector<ServerConfig> ConfigParser::parse(const std::string& path) {
             ++i;
             ServerConfig config = parse_server_block(tokens, i);
             configs.push_back(config);
+        } else if (tokens[i] == "events") {
+            ++i;
+            parse_events_block(tokens, i, global);
+        } else if (i + 1 < tokens.size() && parse_global_directive(tokens, i, global)) {
+            continue;
         } else {
             ++i;
         }
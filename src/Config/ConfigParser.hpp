@@ -24,6 +24,7 @@
 class ConfigParser {
 public:
     static std::vector<ServerConfig> parse(const std::string& path);
+    static std::vector<ServerConfig> parse(const std::string& path, GlobalConfig &global);
 
 };
 
@@ -0,0 +1,143 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   RouteTable.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "RouteTable.hpp"
+#include <cstring>
+
+static void inherit_server_defaults(RouteConfig &route, const ServerConfig &config) {
+    if (!route.autoindex_set) {
+        route.autoindex = config.autoindex;
+        route.autoindex_set = true;
+    }
+    if (route.root.empty()) {
+        route.root = config.root;
+    }
+    if (route.index.empty()) {
+        route.index = config.index;
+    }
+    if (route.upload_dir.empty()) {
+        route.upload_dir = config.upload_dir;
+    }
+    if (route.allowed_methods.empty()) {
+        route.allowed_methods = config.allowed_methods;
+    }
+    if (route.cgi_extensions.empty()) {
+        route.cgi_extensions = config.cgi_extensions;
+        route.cgi_interpreters = config.cgi_interpreters;
+    }
+    if (!route.max_body_size_set) {
+        route.max_body_size = config.max_body_size;
+        route.max_body_size_set = true;
+    }
+}
+
+// Finds the next non-empty '/'-separated segment at or after 'pos'
+static size_t next_segment(const std::string &path, size_t pos, size_t end, size_t &len) {
+    while (pos < end && path[pos] == '/') {
+        ++pos;
+    }
+    size_t stop = pos;
+    while (stop < end && path[stop] != '/') {
+        ++stop;
+    }
+    len = stop - pos;
+    return pos;
+}
+
+RouteTable::RouteTable(const ServerConfig &config) : _root(new Node()) {
+    _default.path = "/";
+    inherit_server_defaults(_default, config);
+
+    for (size_t i = 0; i < config.routes.size(); ++i) {
+        RouteConfig *route = new RouteConfig(config.routes[i]);
+        inherit_server_defaults(*route, config);
+        _routes.push_back(route);
+        _insert(route);
+    }
+}
+
+RouteTable::~RouteTable() {
+    _destroy(_root);
+    for (size_t i = 0; i < _routes.size(); ++i) {
+        delete _routes[i];
+    }
+}
+
+void RouteTable::_destroy(Node *node) {
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        _destroy(node->children[i].second);
+    }
+    delete node;
+}
+
+RouteTable::Node* RouteTable::_find_child(const Node *node, const char *segment, size_t len) {
+    size_t lo = 0;
+    size_t hi = node->children.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int cmp = node->children[mid].first.compare(0, std::string::npos, segment, len);
+        if (cmp == 0) {
+            return node->children[mid].second;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+void RouteTable::_insert(const RouteConfig *route) {
+    Node *node = _root;
+    const std::string &path = route->path;
+    size_t len = 0;
+    size_t pos = next_segment(path, 0, path.size(), len);
+    while (len > 0) {
+        Node *child = _find_child(node, path.data() + pos, len);
+        if (!child) {
+            std::string segment = path.substr(pos, len);
+            std::vector<std::pair<std::string, Node*> >::iterator it = node->children.begin();
+            while (it != node->children.end() && it->first < segment) {
+                ++it;
+            }
+            child = new Node();
+            node->children.insert(it, std::make_pair(segment, child));
+        }
+        node = child;
+        pos = next_segment(path, pos + len, path.size(), len);
+    }
+    // Same path declared twice: the later block wins, as before
+    node->route = route;
+}
+
+const RouteConfig& RouteTable::match(const std::string &path) const {
+    size_t end = path.find('?');
+    if (end == std::string::npos) {
+        end = path.size();
+    }
+    const Node *node = _root;
+    const RouteConfig *best = _root->route;
+    size_t len = 0;
+    size_t pos = next_segment(path, 0, end, len);
+    while (len > 0) {
+        node = _find_child(node, path.data() + pos, len);
+        if (!node) {
+            break;
+        }
+        if (node->route) {
+            best = node->route;
+        }
+        pos = next_segment(path, pos + len, end, len);
+    }
+    return best ? *best : _default;
+}
@@ -0,0 +1,52 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   RouteTable.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef ROUTE_TABLE_HPP
+#define ROUTE_TABLE_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include "Config.hpp"
+
+// A server's locations compiled at load time into a tree keyed by path
+// segment. Every stored RouteConfig already has the server defaults merged
+// in and is never modified afterwards, so lookups hand out const references.
+class RouteTable {
+private:
+    struct Node {
+        std::vector<std::pair<std::string, Node*> > children;  // Sorted by segment
+        const RouteConfig                           *route;
+
+        Node() : route(NULL) {}
+    };
+
+    Node                        *_root;
+    std::vector<RouteConfig*>   _routes;
+    RouteConfig                 _default;   // Used when no location matches
+
+    RouteTable(const RouteTable &);
+    RouteTable &operator=(const RouteTable &);
+
+    void        _insert(const RouteConfig *route);
+    static void _destroy(Node *node);
+    static Node* _find_child(const Node *node, const char *segment, size_t len);
+
+public:
+    explicit RouteTable(const ServerConfig &config);
+    ~RouteTable();
+
+    // Longest location matching whole path segments, O(path length)
+    const RouteConfig&  match(const std::string &path) const;
+};
+
+#endif
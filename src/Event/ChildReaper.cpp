@@ -0,0 +1,102 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ChildReaper.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "ChildReaper.hpp"
+#include <stdexcept>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/signalfd.h>
+#endif
+
+#ifndef __linux__
+static int g_reaper_write_fd = -1;
+
+static void on_sigchld(int) {
+    int saved = errno;
+    char byte = 0;
+    if (write(g_reaper_write_fd, &byte, 1) < 0) {
+        // Pipe full: a wakeup is already pending
+    }
+    errno = saved;
+}
+#endif
+
+ChildReaper::ChildReaper() : _fd(-1), _write_fd(-1) {}
+
+ChildReaper::~ChildReaper() {
+    close();
+}
+
+void ChildReaper::open() {
+    if (_fd != -1) {
+        return;
+    }
+#ifdef __linux__
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    // Scripts are spawned with an empty mask, so they do not inherit this
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    _fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (_fd < 0) {
+        throw std::runtime_error(std::string("signalfd failed: ") + std::strerror(errno));
+    }
+#else
+    int fds[2];
+    if (pipe(fds) < 0) {
+        throw std::runtime_error(std::string("pipe failed: ") + std::strerror(errno));
+    }
+    for (int i = 0; i < 2; ++i) {
+        fcntl(fds[i], F_SETFL, O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    _fd = fds[0];
+    _write_fd = fds[1];
+    g_reaper_write_fd = _write_fd;
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigchld;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+#endif
+}
+
+void ChildReaper::close() {
+    if (_fd != -1) {
+        ::close(_fd);
+        _fd = -1;
+    }
+    if (_write_fd != -1) {
+        ::close(_write_fd);
+        _write_fd = -1;
+    }
+}
+
+void ChildReaper::reap(std::vector<ExitedChild> &exited) {
+    char drain[512];
+    while (_fd != -1 && read(_fd, drain, sizeof(drain)) > 0) {
+    }
+    while (true) {
+        ExitedChild child;
+        child.pid = waitpid(-1, &child.status, WNOHANG);
+        if (child.pid <= 0) {
+            break;
+        }
+        exited.push_back(child);
+    }
+}
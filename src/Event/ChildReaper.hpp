@@ -0,0 +1,49 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ChildReaper.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CHILD_REAPER_HPP
+#define CHILD_REAPER_HPP
+
+#include <vector>
+#include <sys/types.h>
+
+struct ExitedChild {
+    pid_t   pid;
+    int     status;     // As returned by waitpid()
+};
+
+// Turns SIGCHLD into a readable fd for the event loop: a signalfd on Linux
+// (SIGCHLD is blocked so it is only ever delivered there), a self-pipe
+// written by the signal handler elsewhere. Signals coalesce, so every
+// wakeup collects all exited children, not just one.
+class ChildReaper {
+private:
+    int     _fd;
+    int     _write_fd;  // Self-pipe only
+
+    ChildReaper(const ChildReaper &);
+    ChildReaper &operator=(const ChildReaper &);
+
+public:
+    ChildReaper();
+    ~ChildReaper();
+
+    // Throws std::runtime_error when the fd cannot be created
+    void    open();
+    void    close();
+    int     fd() const { return _fd; }
+
+    // Drains the notification and appends every child that exited
+    void    reap(std::vector<ExitedChild> &exited);
+};
+
+#endif
@@ -0,0 +1,96 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   EpollBackend.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "EpollBackend.hpp"
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <cstring>
+#include <stdexcept>
+
+static const size_t kInitialEvents = 256;
+
+static uint32_t to_epoll_events(int events) {
+    uint32_t mask = 0;
+    if (events & EVENT_READ) mask |= EPOLLIN;
+    if (events & EVENT_WRITE) mask |= EPOLLOUT;
+    return mask;
+}
+
+static int from_epoll_events(uint32_t revents) {
+    int events = 0;
+    if (revents & EPOLLIN) events |= EVENT_READ;
+    if (revents & EPOLLOUT) events |= EVENT_WRITE;
+    if (revents & EPOLLHUP) events |= EVENT_HUP;
+    if (revents & EPOLLERR) events |= EVENT_ERROR;
+    return events;
+}
+
+EpollBackend::EpollBackend() : _epoll_fd(-1), _buffer(kInitialEvents) {
+    _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epoll_fd < 0) {
+        throw std::runtime_error("epoll_create1 failed");
+    }
+}
+
+EpollBackend::~EpollBackend() {
+    if (_epoll_fd >= 0) {
+        close(_epoll_fd);
+    }
+}
+
+void EpollBackend::add(int fd, int events) {
+    epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = to_epoll_events(events);
+    ev.data.fd = fd;
+    if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        throw std::runtime_error("epoll_ctl ADD failed");
+    }
+}
+
+void EpollBackend::modify(int fd, int events) {
+    epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = to_epoll_events(events);
+    ev.data.fd = fd;
+    epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void EpollBackend::remove(int fd) {
+    // The event argument is ignored for DEL but must be non-NULL on old kernels
+    epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+int EpollBackend::wait(std::vector<Event> &ready, int timeout_ms) {
+    ready.clear();
+    int count = epoll_wait(_epoll_fd, &_buffer[0], static_cast<int>(_buffer.size()), timeout_ms);
+    if (count <= 0) {
+        return count;
+    }
+    for (int i = 0; i < count; ++i) {
+        Event ev;
+        ev.fd = _buffer[i].data.fd;
+        ev.events = from_epoll_events(_buffer[i].events);
+        ready.push_back(ev);
+    }
+    // A full batch means more fds were probably ready; grow for the next round
+    if (static_cast<size_t>(count) == _buffer.size()) {
+        _buffer.resize(_buffer.size() * 2);
+    }
+    return count;
+}
+
+#endif
@@ -0,0 +1,45 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   EpollBackend.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef EPOLL_BACKEND_HPP
+#define EPOLL_BACKEND_HPP
+
+#include "EventBackend.hpp"
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+
+// Level-triggered epoll reactor: the kernel keeps the interest set, so
+// registration costs O(1) and wait() only returns the fds that are ready.
+class EpollBackend : public EventBackend {
+private:
+    int                         _epoll_fd;
+    std::vector<epoll_event>    _buffer;
+
+    EpollBackend(const EpollBackend &);
+    EpollBackend &operator=(const EpollBackend &);
+
+public:
+    EpollBackend();
+    virtual ~EpollBackend();
+
+    virtual void        add(int fd, int events);
+    virtual void        modify(int fd, int events);
+    virtual void        remove(int fd);
+    virtual int         wait(std::vector<Event> &ready, int timeout_ms);
+    virtual const char* name() const { return "epoll"; }
+};
+
+#endif
+
+#endif
@@ -0,0 +1,29 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   EventBackend.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "EventBackend.hpp"
+#include "PollBackend.hpp"
+#include "EpollBackend.hpp"
+#include <iostream>
+
+EventBackend* EventBackend::create(const std::string &name) {
+#ifdef __linux__
+    if (name == "epoll") {
+        return new EpollBackend();
+    }
+#else
+    if (name == "epoll") {
+        std::cerr << "epoll is not available, falling back to poll" << std::endl;
+    }
+#endif
+    return new PollBackend();
+}
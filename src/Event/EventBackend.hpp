@@ -0,0 +1,49 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   EventBackend.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef EVENT_BACKEND_HPP
+#define EVENT_BACKEND_HPP
+
+#include <string>
+#include <vector>
+
+// Readiness flags shared by every backend, independent of poll()/epoll bits
+enum e_event {
+    EVENT_READ  = 1,
+    EVENT_WRITE = 2,
+    EVENT_HUP   = 4,
+    EVENT_ERROR = 8
+};
+
+struct Event {
+    int fd;
+    int events;
+};
+
+// Small reactor interface: the Server only registers interest and
+// dispatches ready fds, it never touches the underlying poll set.
+class EventBackend {
+public:
+    virtual ~EventBackend() {}
+
+    virtual void        add(int fd, int events) = 0;
+    virtual void        modify(int fd, int events) = 0;
+    virtual void        remove(int fd) = 0;
+    // Fills 'ready' with the fds that have pending events, returns -1 on error
+    virtual int         wait(std::vector<Event> &ready, int timeout_ms) = 0;
+    virtual const char* name() const = 0;
+
+    // "epoll" or "poll"; falls back to poll when epoll is not available
+    static EventBackend* create(const std::string &name);
+};
+
+#endif
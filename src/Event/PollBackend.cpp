@@ -0,0 +1,98 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   PollBackend.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "PollBackend.hpp"
+#include <stdexcept>
+
+static short to_poll_events(int events) {
+    short mask = 0;
+    if (events & EVENT_READ) mask |= POLLIN;
+    if (events & EVENT_WRITE) mask |= POLLOUT;
+    return mask;
+}
+
+static int from_poll_events(short revents) {
+    int events = 0;
+    if (revents & POLLIN) events |= EVENT_READ;
+    if (revents & POLLOUT) events |= EVENT_WRITE;
+    if (revents & POLLHUP) events |= EVENT_HUP;
+    if (revents & (POLLERR | POLLNVAL)) events |= EVENT_ERROR;
+    return events;
+}
+
+PollBackend::PollBackend() {}
+
+int PollBackend::_slot_of(int fd) const {
+    if (fd < 0 || static_cast<size_t>(fd) >= _slots.size()) {
+        return -1;
+    }
+    return _slots[fd];
+}
+
+void PollBackend::add(int fd, int events) {
+    if (fd < 0) {
+        throw std::runtime_error("Invalid fd for poll backend");
+    }
+    if (static_cast<size_t>(fd) >= _slots.size()) {
+        _slots.resize(fd + 1, -1);
+    }
+    if (_slots[fd] != -1) {
+        modify(fd, events);
+        return;
+    }
+    pollfd pfd = {fd, to_poll_events(events), 0};
+    _slots[fd] = static_cast<int>(_fds.size());
+    _fds.push_back(pfd);
+}
+
+void PollBackend::modify(int fd, int events) {
+    int slot = _slot_of(fd);
+    if (slot == -1) {
+        return;
+    }
+    _fds[slot].events = to_poll_events(events);
+}
+
+void PollBackend::remove(int fd) {
+    int slot = _slot_of(fd);
+    if (slot == -1) {
+        return;
+    }
+    size_t last = _fds.size() - 1;
+    if (static_cast<size_t>(slot) != last) {
+        _fds[slot] = _fds[last];
+        _slots[_fds[slot].fd] = slot;
+    }
+    _fds.pop_back();
+    _slots[fd] = -1;
+}
+
+int PollBackend::wait(std::vector<Event> &ready, int timeout_ms) {
+    ready.clear();
+    if (_fds.empty()) {
+        return poll(NULL, 0, timeout_ms);
+    }
+    int count = poll(&_fds[0], _fds.size(), timeout_ms);
+    if (count <= 0) {
+        return count;
+    }
+    for (size_t i = 0; i < _fds.size() && static_cast<int>(ready.size()) < count; ++i) {
+        if (_fds[i].revents == 0) {
+            continue;
+        }
+        Event ev;
+        ev.fd = _fds[i].fd;
+        ev.events = from_poll_events(_fds[i].revents);
+        ready.push_back(ev);
+    }
+    return static_cast<int>(ready.size());
+}
@@ -0,0 +1,39 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   PollBackend.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef POLL_BACKEND_HPP
+#define POLL_BACKEND_HPP
+
+#include <poll.h>
+#include "EventBackend.hpp"
+
+// Portable fallback. Keeps an fd -> slot index so add/modify/remove are O(1);
+// removal swaps the last slot into the hole instead of erasing mid-array.
+class PollBackend : public EventBackend {
+private:
+    std::vector<pollfd> _fds;
+    std::vector<int>    _slots;   // Key: fd, value: index in _fds or -1
+
+    int     _slot_of(int fd) const;
+
+public:
+    PollBackend();
+    virtual ~PollBackend() {}
+
+    virtual void        add(int fd, int events);
+    virtual void        modify(int fd, int events);
+    virtual void        remove(int fd);
+    virtual int         wait(std::vector<Event> &ready, int timeout_ms);
+    virtual const char* name() const { return "poll"; }
+};
+
+#endif
@@ -0,0 +1,96 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   TimerWheel.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "TimerWheel.hpp"
+#include <ctime>
+
+msec_t monotonic_ms() {
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return static_cast<msec_t>(ts.tv_sec) * 1000 + static_cast<msec_t>(ts.tv_nsec) / 1000000;
+}
+
+TimerWheel::TimerWheel(msec_t now)
+    : _slots(kSlots), _next_tick(now / kTickMs), _count(0) {
+    for (size_t i = 0; i < kSlots; ++i) {
+        _slots[i].prev = &_slots[i];
+        _slots[i].next = &_slots[i];
+    }
+}
+
+void TimerWheel::schedule(TimerNode &node, msec_t deadline) {
+    cancel(node);
+    msec_t tick = (deadline + kTickMs - 1) / kTickMs; // Round up: late by a tick, never early
+    if (tick < _next_tick) {
+        tick = _next_tick; // Already due: fires on the next expire()
+    }
+    node.expires_tick = tick;
+    TimerNode &head = _slots[tick % kSlots];
+    node.prev = head.prev;
+    node.next = &head;
+    head.prev->next = &node;
+    head.prev = &node;
+    ++_count;
+}
+
+void TimerWheel::cancel(TimerNode &node) {
+    if (!node.armed()) {
+        return;
+    }
+    node.prev->next = node.next;
+    node.next->prev = node.prev;
+    node.prev = NULL;
+    node.next = NULL;
+    --_count;
+}
+
+void TimerWheel::expire(msec_t now, std::vector<int> &expired) {
+    msec_t now_tick = now / kTickMs;
+    // After a long stall every bucket is visited once, not once per lap
+    size_t visits = 0;
+    while (_next_tick <= now_tick && visits < kSlots) {
+        TimerNode &head = _slots[_next_tick % kSlots];
+        TimerNode *node = head.next;
+        while (node != &head) {
+            TimerNode *next = node->next;
+            if (node->expires_tick <= now_tick) {
+                cancel(*node);
+                expired.push_back(node->id);
+            }
+            node = next;
+        }
+        ++_next_tick;
+        ++visits;
+    }
+    if (_next_tick <= now_tick) {
+        _next_tick = now_tick + 1;
+    }
+}
+
+int TimerWheel::next_timeout(msec_t now, int max_ms) const {
+    if (_count == 0) {
+        return max_ms;
+    }
+    msec_t limit = (now + static_cast<msec_t>(max_ms)) / kTickMs;
+    for (msec_t tick = _next_tick; tick <= limit; ++tick) {
+        const TimerNode &head = _slots[tick % kSlots];
+        if (head.next != &head) {
+            msec_t at = tick * kTickMs;
+            return at <= now ? 0 : static_cast<int>(at - now);
+        }
+    }
+    return max_ms;
+}
@@ -0,0 +1,65 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   TimerWheel.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <cstddef>
+#include <vector>
+
+typedef unsigned long long msec_t;
+
+// Milliseconds from a monotonic clock; the coarse variant when available,
+// since timeouts only need tick precision
+msec_t  monotonic_ms();
+
+// Intrusive wheel entry, embedded in whatever owns the deadline
+struct TimerNode {
+    TimerNode   *prev;
+    TimerNode   *next;
+    msec_t      expires_tick;
+    int         id;             // Handed back on expiry (the owner's fd)
+
+    TimerNode() : prev(NULL), next(NULL), expires_tick(0), id(-1) {}
+    bool    armed() const { return next != NULL; }
+};
+
+// Hashed timing wheel: kSlots buckets of kTickMs each. Scheduling and
+// cancelling are O(1); expiry only visits the buckets the clock passed,
+// and deadlines beyond one revolution wait in their bucket for a later lap.
+class TimerWheel {
+public:
+    static const msec_t kTickMs = 100;
+    static const size_t kSlots = 512;
+
+private:
+    std::vector<TimerNode>  _slots;     // List heads, circular
+    msec_t                  _next_tick; // First tick not processed yet
+    size_t                  _count;
+
+    TimerWheel(const TimerWheel &);
+    TimerWheel &operator=(const TimerWheel &);
+
+public:
+    explicit TimerWheel(msec_t now);
+
+    // (Re)arms 'node' to fire at 'deadline'
+    void    schedule(TimerNode &node, msec_t deadline);
+    void    cancel(TimerNode &node);
+    // Disarms every node due by 'now' and appends its id to 'expired'
+    void    expire(msec_t now, std::vector<int> &expired);
+    // Milliseconds until the earliest bucket with timers, at most 'max_ms'
+    int     next_timeout(msec_t now, int max_ms) const;
+    size_t  size() const { return _count; }
+};
+
+#endif
@@ -0,0 +1,616 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FastCgiClient.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "FastCgiClient.hpp"
+#include "Client.hpp"
+#include "EventBackend.hpp"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/un.h>
+
+// Record types and constants from the FastCGI 1.0 specification
+enum {
+    FCGI_VERSION_1 = 1,
+    FCGI_BEGIN_REQUEST = 1,
+    FCGI_ABORT_REQUEST = 2,
+    FCGI_END_REQUEST = 3,
+    FCGI_PARAMS = 4,
+    FCGI_STDIN = 5,
+    FCGI_STDOUT = 6,
+    FCGI_STDERR = 7,
+    FCGI_GET_VALUES = 9,
+    FCGI_GET_VALUES_RESULT = 10,
+    FCGI_UNKNOWN_TYPE = 11,
+    FCGI_RESPONDER = 1,
+    FCGI_KEEP_CONN = 1,
+    FCGI_REQUEST_COMPLETE = 0
+};
+
+static const size_t kHeaderSize = 8;
+static const size_t kMaxRecordContent = 65535;
+static const size_t kStdinPiece = 32 * 1024;
+static const size_t kOutHighWater = 64 * 1024;    // Stop feeding stdin above this
+static const size_t kMaxMultiplexed = 16;         // Requests per FCGI_MPXS_CONNS connection
+
+struct FastCgiRequest {
+    Client          *client;        // NULL once the client went away
+    int             conn_fd;
+    unsigned short  id;
+    std::string     params;         // Encoded name-value pairs, kept for a retry
+    int             body_fd;
+    std::string     body;
+    off_t           body_offset;
+    off_t           body_size;
+    bool            stdin_done;
+    bool            got_output;
+};
+
+static void append_header(std::string &out, unsigned char type, unsigned short id, size_t len, size_t padding) {
+    char header[kHeaderSize];
+    header[0] = FCGI_VERSION_1;
+    header[1] = static_cast<char>(type);
+    header[2] = static_cast<char>((id >> 8) & 0xff);
+    header[3] = static_cast<char>(id & 0xff);
+    header[4] = static_cast<char>((len >> 8) & 0xff);
+    header[5] = static_cast<char>(len & 0xff);
+    header[6] = static_cast<char>(padding);
+    header[7] = 0;
+    out.append(header, kHeaderSize);
+}
+
+// Splits 'data' into records; an empty 'data' writes the end-of-stream record
+static void append_record(std::string &out, unsigned char type, unsigned short id, const char *data, size_t len) {
+    do {
+        size_t piece = len < kMaxRecordContent ? len : kMaxRecordContent;
+        size_t padding = (8 - piece % 8) % 8;
+        append_header(out, type, id, piece, padding);
+        out.append(data, piece);
+        out.append(padding, '\0');
+        data += piece;
+        len -= piece;
+    } while (len > 0);
+}
+
+static void append_length(std::string &out, size_t len) {
+    if (len < 128) {
+        out += static_cast<char>(len);
+        return;
+    }
+    out += static_cast<char>(((len >> 24) & 0x7f) | 0x80);
+    out += static_cast<char>((len >> 16) & 0xff);
+    out += static_cast<char>((len >> 8) & 0xff);
+    out += static_cast<char>(len & 0xff);
+}
+
+static void append_pair(std::string &out, const std::string &name, const std::string &value) {
+    append_length(out, name.size());
+    append_length(out, value.size());
+    out += name;
+    out += value;
+}
+
+static bool read_length(const unsigned char *data, size_t len, size_t &pos, size_t &value) {
+    if (pos >= len) {
+        return false;
+    }
+    if (data[pos] < 128) {
+        value = data[pos++];
+        return true;
+    }
+    if (pos + 4 > len) {
+        return false;
+    }
+    value = (static_cast<size_t>(data[pos] & 0x7f) << 24) | (static_cast<size_t>(data[pos + 1]) << 16)
+        | (static_cast<size_t>(data[pos + 2]) << 8) | data[pos + 3];
+    pos += 4;
+    return true;
+}
+
+FastCgiClient::FastCgiClient(FastCgiEvents &events) : _events(events) {}
+
+FastCgiClient::~FastCgiClient() {
+    close_all();
+}
+
+bool FastCgiClient::valid_address(const std::string &address) {
+    if (address.compare(0, 5, "unix:") == 0) {
+        return address.size() > 5 && address.size() - 5 < sizeof(((struct sockaddr_un *)0)->sun_path);
+    }
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == address.size()) {
+        return false;
+    }
+    int port = std::atoi(address.c_str() + colon + 1);
+    return port > 0 && port <= 65535;
+}
+
+bool FastCgiClient::resolve(const std::string &address, struct sockaddr_storage &addr, socklen_t &addr_len) {
+    if (!valid_address(address)) {
+        return false;
+    }
+    std::memset(&addr, 0, sizeof(addr));
+    if (address.compare(0, 5, "unix:") == 0) {
+        struct sockaddr_un *un = reinterpret_cast<struct sockaddr_un *>(&addr);
+        un->sun_family = AF_UNIX;
+        std::strcpy(un->sun_path, address.c_str() + 5);
+        addr_len = sizeof(struct sockaddr_un);
+        return true;
+    }
+    size_t colon = address.rfind(':');
+    std::string host = address.substr(0, colon);
+    if (host.size() > 2 && host[0] == '[') {
+        host = host.substr(1, host.size() - 2);
+    }
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), address.c_str() + colon + 1, &hints, &res) != 0 || !res) {
+        return false;
+    }
+    std::memcpy(&addr, res->ai_addr, res->ai_addrlen);
+    addr_len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return true;
+}
+
+// One pool per address, created by the first request that uses it
+FastCgiClient::Upstream* FastCgiClient::_upstream(const std::string &address, const struct sockaddr_storage &addr,
+                                                  socklen_t addr_len) {
+    std::map<std::string, Upstream*>::iterator it = _upstreams.find(address);
+    if (it != _upstreams.end()) {
+        return it->second;
+    }
+    if (addr_len == 0) {
+        return NULL;
+    }
+    Upstream *upstream = new Upstream();
+    upstream->address = address;
+    upstream->addr = addr;
+    upstream->addr_len = addr_len;
+    _upstreams[address] = upstream;
+    return upstream;
+}
+
+FastCgiClient::Connection* FastCgiClient::_pick_connection(Upstream &upstream) {
+    Connection *idle = NULL;
+    for (size_t i = 0; i < upstream.connections.size(); ++i) {
+        Connection *conn = upstream.connections[i];
+        if (conn->mpxs && !conn->paused && conn->requests.size() < kMaxMultiplexed) {
+            return conn;
+        }
+        if (!idle && conn->requests.empty()) {
+            idle = conn;
+        }
+    }
+    return idle ? idle : _connect(upstream);
+}
+
+FastCgiClient::Connection* FastCgiClient::_connect(Upstream &upstream) {
+    int fd = socket(upstream.addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    int rc = connect(fd, reinterpret_cast<struct sockaddr *>(&upstream.addr), upstream.addr_len);
+    if (rc < 0 && errno != EINPROGRESS) {
+        std::cerr << "FastCGI connect to " << upstream.address << " failed: " << std::strerror(errno) << std::endl;
+        close(fd);
+        return NULL;
+    }
+    Connection *conn = new Connection();
+    conn->fd = fd;
+    conn->upstream = &upstream;
+    conn->connected = (rc == 0);
+    conn->mpxs_known = false;
+    conn->mpxs = false;
+    conn->reused = false;
+    conn->paused = false;
+    conn->out_pos = 0;
+    conn->next_id = 1;
+    // Ask once whether requests may share this connection
+    std::string query;
+    append_pair(query, "FCGI_MPXS_CONNS", "");
+    append_record(conn->out, FCGI_GET_VALUES, 0, query.data(), query.size());
+
+    if (static_cast<size_t>(fd) >= _by_fd.size()) {
+        _by_fd.resize(static_cast<size_t>(fd) * 2 + 1, NULL);
+    }
+    _by_fd[fd] = conn;
+    upstream.connections.push_back(conn);
+    _update_interest(*conn);
+    return conn;
+}
+
+void FastCgiClient::_assign(Connection &conn, FastCgiRequest *req) {
+    unsigned short id = conn.next_id;
+    while (id == 0 || conn.requests.count(id)) {
+        ++id;
+    }
+    conn.next_id = static_cast<unsigned short>(id + 1);
+    conn.requests[id] = req;
+    req->id = id;
+    req->conn_fd = conn.fd;
+    req->body_offset = 0;
+    req->stdin_done = false;
+
+    char begin[8] = { 0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0 };
+    append_record(conn.out, FCGI_BEGIN_REQUEST, id, begin, sizeof(begin));
+    if (!req->params.empty()) {
+        append_record(conn.out, FCGI_PARAMS, id, req->params.data(), req->params.size());
+    }
+    append_record(conn.out, FCGI_PARAMS, id, NULL, 0);
+    _pump_stdin(conn);
+    _update_interest(conn);
+}
+
+// Turns request bodies into STDIN records while the connection's output
+// stays under kOutHighWater, so a large body never sits in memory whole
+void FastCgiClient::_pump_stdin(Connection &conn) {
+    std::map<unsigned short, FastCgiRequest*>::iterator it = conn.requests.begin();
+    while (conn.out.size() - conn.out_pos < kOutHighWater && it != conn.requests.end()) {
+        FastCgiRequest *req = it->second;
+        if (req->stdin_done) {
+            ++it;
+            continue;
+        }
+        off_t left = req->body_size - req->body_offset;
+        if (left == 0) {
+            append_record(conn.out, FCGI_STDIN, req->id, NULL, 0);
+            req->stdin_done = true;
+            continue;
+        }
+        size_t piece = left < static_cast<off_t>(kStdinPiece) ? static_cast<size_t>(left) : kStdinPiece;
+        if (req->body_fd == -1) {
+            append_record(conn.out, FCGI_STDIN, req->id, req->body.data() + req->body_offset, piece);
+        } else {
+            char buffer[kStdinPiece];
+            ssize_t bytes = pread(req->body_fd, buffer, piece, req->body_offset);
+            if (bytes <= 0) {
+                // Truncated spool: end the stream, the script sees a short body
+                req->body_size = req->body_offset;
+                continue;
+            }
+            piece = static_cast<size_t>(bytes);
+            append_record(conn.out, FCGI_STDIN, req->id, buffer, piece);
+        }
+        req->body_offset += static_cast<off_t>(piece);
+    }
+}
+
+void FastCgiClient::_flush(Connection &conn) {
+    while (conn.out_pos < conn.out.size()) {
+        ssize_t sent = send(conn.fd, conn.out.data() + conn.out_pos, conn.out.size() - conn.out_pos, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            _fail(conn);
+            return;
+        }
+        conn.out_pos += static_cast<size_t>(sent);
+        if (conn.out_pos == conn.out.size()) {
+            conn.out.clear();
+            conn.out_pos = 0;
+            _pump_stdin(conn);
+        }
+    }
+    if (conn.out_pos > kOutHighWater) {
+        conn.out.erase(0, conn.out_pos);
+        conn.out_pos = 0;
+    }
+    _update_interest(conn);
+}
+
+// Returns false when the connection was closed while reading
+bool FastCgiClient::_read(Connection &conn) {
+    char buffer[65536];
+    while (true) {
+        ssize_t bytes = recv(conn.fd, buffer, sizeof(buffer), 0);
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (bytes <= 0) {
+            _fail(conn);
+            return false;
+        }
+        conn.in.append(buffer, bytes);
+        if (static_cast<size_t>(bytes) < sizeof(buffer)) {
+            break;
+        }
+    }
+
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(conn.in.data());
+    size_t pos = 0;
+    while (conn.in.size() - pos >= kHeaderSize) {
+        const unsigned char *header = data + pos;
+        size_t len = (static_cast<size_t>(header[4]) << 8) | header[5];
+        size_t total = kHeaderSize + len + header[6];
+        if (conn.in.size() - pos < total) {
+            break;
+        }
+        if (header[0] != FCGI_VERSION_1) {
+            std::cerr << "Malformed FastCGI record from " << conn.upstream->address << std::endl;
+            _fail(conn);
+            return false;
+        }
+        unsigned short id = static_cast<unsigned short>((header[2] << 8) | header[3]);
+        _process_record(conn, header[1], id, conn.in.data() + pos + kHeaderSize, len);
+        pos += total;
+    }
+    conn.in.erase(0, pos);
+    return !_release_if_idle(conn);
+}
+
+bool FastCgiClient::_process_record(Connection &conn, unsigned char type, unsigned short id,
+                                    const char *data, size_t len) {
+    if (type == FCGI_GET_VALUES_RESULT) {
+        const unsigned char *pairs = reinterpret_cast<const unsigned char *>(data);
+        size_t pos = 0;
+        size_t name_len = 0;
+        size_t value_len = 0;
+        while (read_length(pairs, len, pos, name_len) && read_length(pairs, len, pos, value_len)
+                && pos + name_len + value_len <= len) {
+            std::string name(data + pos, name_len);
+            std::string value(data + pos + name_len, value_len);
+            if (name == "FCGI_MPXS_CONNS") {
+                conn.mpxs = (value == "1");
+            }
+            pos += name_len + value_len;
+        }
+        conn.mpxs_known = true;
+        return true;
+    }
+    if (type == FCGI_UNKNOWN_TYPE) {
+        conn.mpxs_known = true; // No FCGI_GET_VALUES: one request at a time
+        return true;
+    }
+    std::map<unsigned short, FastCgiRequest*>::iterator it = conn.requests.find(id);
+    if (it == conn.requests.end()) {
+        return true; // Aborted request, or a record for an id we never used
+    }
+    FastCgiRequest *req = it->second;
+    if (type == FCGI_STDOUT && len > 0) {
+        req->got_output = true;
+        if (req->client) {
+            _events.fastcgi_output(*req->client, data, len);
+        }
+    } else if (type == FCGI_STDERR && len > 0) {
+        std::cerr << "FastCGI " << conn.upstream->address << ": " << std::string(data, len) << std::endl;
+    } else if (type == FCGI_END_REQUEST) {
+        bool complete = len >= 5 && static_cast<unsigned char>(data[4]) == FCGI_REQUEST_COMPLETE;
+        _finish(conn, req, complete);
+    }
+    return true;
+}
+
+void FastCgiClient::_complete(FastCgiRequest *req, bool ok) {
+    if (req->client) {
+        Client &c = *req->client;
+        c.fastcgi = NULL;
+        _events.fastcgi_finished(c, ok);
+    }
+    if (req->body_fd != -1) {
+        close(req->body_fd);
+    }
+    delete req;
+}
+
+void FastCgiClient::_finish(Connection &conn, FastCgiRequest *req, bool ok) {
+    conn.requests.erase(req->id);
+    _complete(req, ok);
+}
+
+// The connection broke. Requests that went out on a pooled connection and
+// got nothing back yet are retried once on a fresh one: the backend may
+// just have closed an idle keep-alive connection.
+void FastCgiClient::_fail(Connection &conn) {
+    std::vector<FastCgiRequest*> pending;
+    for (std::map<unsigned short, FastCgiRequest*>::iterator it = conn.requests.begin();
+            it != conn.requests.end(); ++it) {
+        pending.push_back(it->second);
+    }
+    conn.requests.clear();
+    bool retry = conn.reused;
+    Upstream &upstream = *conn.upstream;
+    _close(conn);
+
+    for (size_t i = 0; i < pending.size(); ++i) {
+        FastCgiRequest *req = pending[i];
+        if (req->client && retry && !req->got_output) {
+            Connection *fresh = _connect(upstream);
+            if (fresh) {
+                _assign(*fresh, req);
+                continue;
+            }
+        }
+        if (req->client) {
+            std::cerr << "FastCGI backend " << upstream.address << " failed" << std::endl;
+        }
+        _complete(req, false);
+    }
+}
+
+void FastCgiClient::_close(Connection &conn) {
+    _events.fastcgi_unwatch(conn.fd);
+    close(conn.fd);
+    _by_fd[conn.fd] = NULL;
+    std::vector<Connection*> &list = conn.upstream->connections;
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (list[i] == &conn) {
+            list.erase(list.begin() + i);
+            break;
+        }
+    }
+    delete &conn;
+}
+
+// Keeps a finished connection for the next request unless the pool for its
+// address is full. Returns true when the connection was closed.
+bool FastCgiClient::_release_if_idle(Connection &conn) {
+    if (!conn.requests.empty()) {
+        return false;
+    }
+    conn.paused = false;
+    size_t idle = 0;
+    const std::vector<Connection*> &list = conn.upstream->connections;
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (list[i]->requests.empty()) {
+            ++idle;
+        }
+    }
+    if (idle > kMaxIdleConnections) {
+        _close(conn);
+        return true;
+    }
+    conn.reused = true;
+    return false;
+}
+
+void FastCgiClient::_update_interest(Connection &conn) {
+    int events = EVENT_WRITE;
+    if (conn.connected) {
+        events = (conn.paused ? 0 : EVENT_READ) | (conn.out_pos < conn.out.size() ? EVENT_WRITE : 0);
+    }
+    _events.fastcgi_watch(conn.fd, events);
+}
+
+bool FastCgiClient::start(Client &c, const std::string &address, const struct sockaddr_storage &addr,
+                          socklen_t addr_len, const std::map<std::string, std::string> &params, int body_fd,
+                          off_t body_size, const std::string &body) {
+    Upstream *upstream = _upstream(address, addr, addr_len);
+    Connection *conn = upstream ? _pick_connection(*upstream) : NULL;
+    if (!conn) {
+        if (body_fd != -1) {
+            close(body_fd);
+        }
+        return false;
+    }
+    FastCgiRequest *req = new FastCgiRequest();
+    req->client = &c;
+    req->conn_fd = -1;
+    req->id = 0;
+    for (std::map<std::string, std::string>::const_iterator it = params.begin(); it != params.end(); ++it) {
+        append_pair(req->params, it->first, it->second);
+    }
+    req->body_fd = body_fd;
+    if (body_fd == -1) {
+        req->body = body;
+        body_size = static_cast<off_t>(req->body.size());
+    }
+    req->body_offset = 0;
+    req->body_size = body_size;
+    req->stdin_done = false;
+    req->got_output = false;
+    c.fastcgi = req;
+    _assign(*conn, req);
+    return true;
+}
+
+void FastCgiClient::abort(Client &c) {
+    FastCgiRequest *req = c.fastcgi;
+    if (!req) {
+        return;
+    }
+    c.fastcgi = NULL;
+    req->client = NULL;
+    Connection *conn = owns(req->conn_fd) ? _by_fd[req->conn_fd] : NULL;
+    if (!conn) {
+        return;
+    }
+    if (conn->requests.size() == 1 || !conn->connected) {
+        // Nothing else rides on it: closing is the cheapest abort
+        conn->requests.erase(req->id);
+        _complete(req, false);
+        if (conn->requests.empty()) {
+            _close(*conn);
+        }
+        return;
+    }
+    // Stop feeding its body; the backend answers with END_REQUEST
+    req->stdin_done = true;
+    append_record(conn->out, FCGI_ABORT_REQUEST, req->id, NULL, 0);
+    _update_interest(*conn);
+}
+
+void FastCgiClient::set_paused(Client &c, bool paused) {
+    FastCgiRequest *req = c.fastcgi;
+    Connection *conn = req && owns(req->conn_fd) ? _by_fd[req->conn_fd] : NULL;
+    if (!conn || conn->paused == paused || (paused && conn->requests.size() != 1)) {
+        return;
+    }
+    conn->paused = paused;
+    _update_interest(*conn);
+}
+
+void FastCgiClient::handle(int fd, int events) {
+    if (!owns(fd)) {
+        return;
+    }
+    Connection &conn = *_by_fd[fd];
+    if (!conn.connected) {
+        if (!(events & (EVENT_WRITE | EVENT_HUP | EVENT_ERROR))) {
+            return;
+        }
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+            std::cerr << "FastCGI connect to " << conn.upstream->address << " failed: "
+                      << std::strerror(error ? error : errno) << std::endl;
+            _fail(conn);
+            return;
+        }
+        conn.connected = true;
+    }
+    if ((events & (EVENT_READ | EVENT_HUP | EVENT_ERROR)) && !_read(conn)) {
+        return;
+    }
+    if (events & EVENT_WRITE) {
+        _flush(conn);
+        return;
+    }
+    _update_interest(conn);
+}
+
+bool FastCgiClient::owns(int fd) const {
+    return fd >= 0 && static_cast<size_t>(fd) < _by_fd.size() && _by_fd[fd] != NULL;
+}
+
+void FastCgiClient::close_all() {
+    for (size_t fd = 0; fd < _by_fd.size(); ++fd) {
+        Connection *conn = _by_fd[fd];
+        if (!conn) {
+            continue;
+        }
+        for (std::map<unsigned short, FastCgiRequest*>::iterator it = conn->requests.begin();
+                it != conn->requests.end(); ++it) {
+            if (it->second->client) {
+                it->second->client->fastcgi = NULL;
+                it->second->client = NULL;
+            }
+            _complete(it->second, false);
+        }
+        conn->requests.clear();
+        _close(*conn);
+    }
+    for (std::map<std::string, Upstream*>::iterator it = _upstreams.begin(); it != _upstreams.end(); ++it) {
+        delete it->second;
+    }
+    _upstreams.clear();
+}
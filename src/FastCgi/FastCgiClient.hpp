@@ -0,0 +1,123 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FastCgiClient.hpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef FASTCGI_CLIENT_HPP
+#define FASTCGI_CLIENT_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+class Client;
+
+// What the FastCGI client needs from the event loop
+class FastCgiEvents {
+public:
+    virtual ~FastCgiEvents() {}
+    // Registers 'fd' or updates its interest (EVENT_READ / EVENT_WRITE)
+    virtual void    fastcgi_watch(int fd, int events) = 0;
+    virtual void    fastcgi_unwatch(int fd) = 0;
+    // FCGI_STDOUT payload for 'c'
+    virtual void    fastcgi_output(Client &c, const char *data, size_t len) = 0;
+    // The backend finished the client's request; 'ok' is false when it
+    // failed before completing (connection refused, reset, ...)
+    virtual void    fastcgi_finished(Client &c, bool ok) = 0;
+};
+
+struct FastCgiRequest;
+
+// Non-blocking FastCGI client living inside the event loop. Requests to the
+// same fastcgi_pass address share a pool of FCGI_KEEP_CONN connections;
+// a connection carries several requests at once when the backend reports
+// FCGI_MPXS_CONNS, one at a time otherwise. Script output is appended to
+// the client's output queue as STDOUT records arrive.
+class FastCgiClient {
+private:
+    struct Upstream;
+
+    struct Connection {
+        int             fd;
+        Upstream        *upstream;
+        bool            connected;
+        bool            mpxs_known;     // FCGI_GET_VALUES answered
+        bool            mpxs;
+        bool            reused;         // Came from the idle pool
+        bool            paused;         // Not read while its only client is backed up
+        std::string     out;
+        size_t          out_pos;
+        std::string     in;
+        std::map<unsigned short, FastCgiRequest*> requests;
+        unsigned short  next_id;
+    };
+
+    struct Upstream {
+        std::string                 address;
+        struct sockaddr_storage     addr;
+        socklen_t                   addr_len;
+        std::vector<Connection*>    connections;
+    };
+
+    FastCgiEvents                       &_events;
+    std::map<std::string, Upstream*>    _upstreams;
+    std::vector<Connection*>            _by_fd;
+
+    FastCgiClient(const FastCgiClient &);
+    FastCgiClient &operator=(const FastCgiClient &);
+
+    Upstream*   _upstream(const std::string &address, const struct sockaddr_storage &addr, socklen_t addr_len);
+    Connection* _pick_connection(Upstream &upstream);
+    Connection* _connect(Upstream &upstream);
+    void        _assign(Connection &conn, FastCgiRequest *req);
+    void        _pump_stdin(Connection &conn);
+    void        _flush(Connection &conn);
+    bool        _read(Connection &conn);
+    bool        _process_record(Connection &conn, unsigned char type, unsigned short id,
+                                const char *data, size_t len);
+    void        _finish(Connection &conn, FastCgiRequest *req, bool ok);
+    void        _complete(FastCgiRequest *req, bool ok);
+    void        _fail(Connection &conn);
+    void        _close(Connection &conn);
+    bool        _release_if_idle(Connection &conn);
+    void        _update_interest(Connection &conn);
+
+public:
+    // Idle keep-alive connections kept per backend address
+    static const size_t kMaxIdleConnections = 8;
+
+    explicit FastCgiClient(FastCgiEvents &events);
+    ~FastCgiClient();
+
+    static bool valid_address(const std::string &address);
+    // Turns a fastcgi_pass address into a socket address. May block on
+    // DNS, so it is only called while loading the configuration.
+    static bool resolve(const std::string &address, struct sockaddr_storage &addr, socklen_t &addr_len);
+
+    // Starts a FCGI_RESPONDER request for 'c' on the backend 'address'
+    // resolved to 'addr'. The body is read from
+    // 'body_fd' when it is not -1, from 'body' otherwise; 'body_fd' is
+    // always taken over. Returns false when no connection could be made.
+    bool    start(Client &c, const std::string &address, const struct sockaddr_storage &addr, socklen_t addr_len,
+                  const std::map<std::string, std::string> &params, int body_fd, off_t body_size,
+                  const std::string &body);
+    // The client is going away: its output is dropped and the request aborted
+    void    abort(Client &c);
+    // Stops or resumes reading the connection serving 'c'; only done when
+    // no other request shares it
+    void    set_paused(Client &c, bool paused);
+    void    handle(int fd, int events);
+    bool    owns(int fd) const;
+    void    close_all();
+};
+
+#endif
@@ -0,0 +1,174 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Master.cpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "Master.hpp"
+#include "Server.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+static const unsigned int kSpawnRetrySeconds = 1;  // Between fork() attempts for an empty slot
+
+int run_worker(const std::vector<ServerConfig> &configs, const GlobalConfig &global) {
+    Server webserv;
+    try {
+        webserv.set_global_config(global);
+        webserv.set_configs(configs);
+
+        // One listener per distinct address, shared by its server blocks
+        webserv.setup_listeners();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return WORKER_FATAL_EXIT;
+    }
+    // Past startup a failure is this worker's alone: let the master respawn it
+    try {
+        webserv.run();
+    } catch (const std::exception& e) {
+        std::cerr << "Worker error: " << e.what() << std::endl;
+        return WORKER_RUNTIME_EXIT;
+    }
+    return 0;
+}
+
+Master::Master(const std::vector<ServerConfig> &configs, const GlobalConfig &global)
+    : _configs(configs), _global(global) {}
+
+int Master::worker_count(const GlobalConfig &global) {
+    if (global.worker_processes > 0) {
+        return global.worker_processes;
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? static_cast<int>(cpus) : 1;
+}
+
+void Master::_pin_to_cpu(size_t slot) const {
+#ifdef __linux__
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus <= 0) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(slot % static_cast<size_t>(cpus), &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        std::cerr << "Could not pin worker " << slot << " to a CPU" << std::endl;
+    }
+#else
+    (void)slot;
+#endif
+}
+
+pid_t Master::_spawn(size_t slot) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "Could not fork worker " << slot << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+    if (pid == 0) {
+        // --- WORKER PROCESS ---
+        if (_global.worker_cpu_affinity) {
+            _pin_to_cpu(slot);
+        }
+        std::exit(run_worker(_configs, _global));
+    }
+    _workers[slot].pid = pid;
+    _workers[slot].started = time(NULL);
+    std::cout << "Started worker " << slot << " (pid " << pid << ")" << std::endl;
+    return pid;
+}
+
+int Master::_slot_of(pid_t pid) const {
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        if (_workers[i].pid == pid) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+// Forks a worker for every slot left empty by a failed respawn. Returns
+// false while some slot is still empty.
+bool Master::_fill_empty_slots() {
+    bool complete = true;
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        if (_workers[i].pid < 0 && _spawn(i) < 0) {
+            complete = false;
+        }
+    }
+    return complete;
+}
+
+void Master::_shutdown_workers() {
+    // Stop the workers one after another so in-flight responses drain in order
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        if (_workers[i].pid <= 0) {
+            continue;
+        }
+        kill(_workers[i].pid, SIGINT);
+        while (waitpid(_workers[i].pid, NULL, 0) < 0 && errno == EINTR) {
+        }
+        std::cout << "Worker " << i << " stopped" << std::endl;
+        _workers[i].pid = -1;
+    }
+}
+
+int Master::run() {
+    Worker empty = {-1, 0};
+    _workers.assign(worker_count(_global), empty);
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        if (_spawn(i) < 0) {
+            _shutdown_workers();
+            return 1;
+        }
+    }
+
+    int exit_code = 0;
+    while (!g_shutdown_requested) {
+        bool complete = _fill_empty_slots();
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, complete ? 0 : WNOHANG);
+        if (pid == 0 || (pid < 0 && errno == ECHILD && !complete)) {
+            std::cerr << "Retrying the missing workers in " << kSpawnRetrySeconds << "s" << std::endl;
+            sleep(kSpawnRetrySeconds);
+            continue;
+        }
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        int slot = _slot_of(pid);
+        if (slot < 0) {
+            continue;
+        }
+        _workers[slot].pid = -1;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == WORKER_FATAL_EXIT) {
+            std::cerr << "Worker " << slot << " failed to start, shutting down" << std::endl;
+            exit_code = 1;
+            break;
+        }
+        if (g_shutdown_requested) {
+            break;
+        }
+        std::cerr << "Worker " << slot << " (pid " << pid << ") died, respawning" << std::endl;
+        // Do not spin if a worker keeps crashing right after startup
+        if (time(NULL) - _workers[slot].started < 1) {
+            sleep(1);
+        }
+        // Forked at the top of the loop, and retried there if fork() fails
+    }
+    _shutdown_workers();
+    return exit_code;
+}
@@ -0,0 +1,59 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Master.hpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef MASTER_HPP
+#define MASTER_HPP
+
+#include <vector>
+#include <ctime>
+#include <sys/types.h>
+#include "Config.hpp"
+
+// Exit status a worker uses when it cannot even start (bad bind, ...);
+// the master treats it as fatal instead of respawning forever.
+#define WORKER_FATAL_EXIT 2
+// Exit status of a worker that failed while serving; it is respawned
+#define WORKER_RUNTIME_EXIT 1
+
+// Forks and supervises the worker processes. Each worker builds its own
+// Server and binds its own SO_REUSEPORT listeners, so the kernel spreads
+// incoming connections across all of them.
+class Master {
+private:
+    struct Worker {
+        pid_t   pid;
+        time_t  started;
+    };
+
+    std::vector<ServerConfig>   _configs;
+    GlobalConfig                _global;
+    std::vector<Worker>         _workers;   // Index is the worker slot / CPU
+
+    pid_t   _spawn(size_t slot);
+    bool    _fill_empty_slots();
+    void    _pin_to_cpu(size_t slot) const;
+    void    _shutdown_workers();
+    int     _slot_of(pid_t pid) const;
+
+public:
+    Master(const std::vector<ServerConfig> &configs, const GlobalConfig &global);
+    ~Master() {}
+
+    static int  worker_count(const GlobalConfig &global);
+    // Runs the supervision loop until SIGINT, returns the process exit code
+    int         run();
+};
+
+// Builds a Server, binds its listeners and runs the loop in this process
+int run_worker(const std::vector<ServerConfig> &configs, const GlobalConfig &global);
+
+#endif
@@ -0,0 +1,153 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ChunkedDecoder.cpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "ChunkedDecoder.hpp"
+
+static const size_t kMaxTrailerBytes = 8192;
+
+static int hex_value(char ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+ChunkedDecoder::ChunkedDecoder() {
+    reset();
+}
+
+void ChunkedDecoder::reset() {
+    _state = CHUNK_SIZE;
+    _chunk_size = 0;
+    _remaining = 0;
+    _size_digits = 0;
+    _trailer_bytes = 0;
+}
+
+ChunkedDecoder::e_result ChunkedDecoder::feed(const char *data, size_t len, size_t &consumed, BodySink &sink) {
+    size_t i = 0;
+    while (i < len && _state != CHUNK_DONE && _state != CHUNK_ERROR) {
+        char ch = data[i];
+        switch (_state) {
+        case CHUNK_SIZE: {
+            int digit = hex_value(ch);
+            if (digit >= 0) {
+                if (_chunk_size > (static_cast<size_t>(-1) >> 4)) {
+                    _state = CHUNK_ERROR; // Size does not fit
+                    break;
+                }
+                _chunk_size = (_chunk_size << 4) | static_cast<size_t>(digit);
+                ++_size_digits;
+            } else if (_size_digits == 0) {
+                _state = CHUNK_ERROR;
+                break;
+            } else if (ch == ';' || ch == ' ' || ch == '\t') {
+                _state = CHUNK_EXTENSION;
+            } else if (ch == '\r') {
+                _state = CHUNK_SIZE_LF;
+            } else if (ch == '\n') {
+                _state = CHUNK_SIZE_LF;
+                continue; // Bare LF: let CHUNK_SIZE_LF see it
+            } else {
+                _state = CHUNK_ERROR;
+                break;
+            }
+            ++i;
+            break;
+        }
+        case CHUNK_EXTENSION:
+            if (ch == '\r' || ch == '\n') {
+                _state = CHUNK_SIZE_LF;
+                if (ch == '\n') continue;
+            }
+            ++i;
+            break;
+        case CHUNK_SIZE_LF:
+            if (ch != '\n') {
+                _state = CHUNK_ERROR;
+                break;
+            }
+            ++i;
+            _remaining = _chunk_size;
+            _state = (_chunk_size == 0) ? CHUNK_TRAILER_START : CHUNK_DATA;
+            break;
+        case CHUNK_DATA: {
+            size_t take = len - i < _remaining ? len - i : _remaining;
+            if (!sink.write_body(data + i, take)) {
+                _state = CHUNK_ERROR;
+                break;
+            }
+            i += take;
+            _remaining -= take;
+            if (_remaining == 0) {
+                _state = CHUNK_DATA_CR;
+            }
+            break;
+        }
+        case CHUNK_DATA_CR:
+            if (ch == '\r') {
+                _state = CHUNK_DATA_LF;
+                ++i;
+            } else if (ch == '\n') {
+                _state = CHUNK_DATA_LF;
+            } else {
+                _state = CHUNK_ERROR;
+            }
+            break;
+        case CHUNK_DATA_LF:
+            if (ch != '\n') {
+                _state = CHUNK_ERROR;
+                break;
+            }
+            ++i;
+            _chunk_size = 0;
+            _size_digits = 0;
+            _state = CHUNK_SIZE;
+            break;
+        case CHUNK_TRAILER_START:
+            if (ch == '\r') {
+                _state = CHUNK_FINAL_LF;
+                ++i;
+            } else if (ch == '\n') {
+                _state = CHUNK_DONE;
+                ++i;
+            } else {
+                _state = CHUNK_TRAILER_LINE;
+            }
+            break;
+        case CHUNK_TRAILER_LINE:
+            if (++_trailer_bytes > kMaxTrailerBytes) {
+                _state = CHUNK_ERROR;
+                break;
+            }
+            if (ch == '\n') {
+                _state = CHUNK_TRAILER_START;
+            }
+            ++i;
+            break;
+        case CHUNK_FINAL_LF:
+            if (ch != '\n') {
+                _state = CHUNK_ERROR;
+                break;
+            }
+            ++i;
+            _state = CHUNK_DONE;
+            break;
+        default:
+            break;
+        }
+    }
+    consumed = i;
+    if (_state == CHUNK_DONE) return CHUNKED_DONE;
+    if (_state == CHUNK_ERROR) return CHUNKED_ERROR;
+    return CHUNKED_NEED_MORE;
+}
@@ -0,0 +1,67 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ChunkedDecoder.hpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CHUNKED_DECODER_HPP
+#define CHUNKED_DECODER_HPP
+
+#include <cstddef>
+
+// Receives decoded payload bytes; returning false aborts decoding
+class BodySink {
+public:
+    virtual ~BodySink() {}
+    virtual bool write_body(const char *data, size_t len) = 0;
+};
+
+// Resumable Transfer-Encoding: chunked decoder. It consumes its input in
+// place, hands payload straight to a BodySink and keeps only a few scalars
+// between calls, so the caller can drop consumed bytes after every read.
+// Chunk extensions are ignored and trailer fields are skipped.
+class ChunkedDecoder {
+public:
+    enum e_result {
+        CHUNKED_NEED_MORE,
+        CHUNKED_DONE,
+        CHUNKED_ERROR
+    };
+
+private:
+    enum e_chunk_state {
+        CHUNK_SIZE,
+        CHUNK_EXTENSION,
+        CHUNK_SIZE_LF,
+        CHUNK_DATA,
+        CHUNK_DATA_CR,
+        CHUNK_DATA_LF,
+        CHUNK_TRAILER_START,
+        CHUNK_TRAILER_LINE,
+        CHUNK_FINAL_LF,
+        CHUNK_DONE,
+        CHUNK_ERROR
+    };
+
+    e_chunk_state   _state;
+    size_t          _chunk_size;
+    size_t          _remaining;     // Payload bytes left in the current chunk
+    size_t          _size_digits;
+    size_t          _trailer_bytes;
+
+public:
+    ChunkedDecoder();
+
+    void        reset();
+    // Decodes as much of [data, data + len) as possible; 'consumed' tells how
+    // many bytes were used (everything after a final chunk is left alone)
+    e_result    feed(const char *data, size_t len, size_t &consumed, BodySink &sink);
+};
+
+#endif
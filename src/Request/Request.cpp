@@ -10,11 +10,14 @@
 /*                                                                            */
 /* ************************************************************************** */
 
+
 #include "Request.hpp"
+#include <strings.h>
+#include <cstring>
 
 /*
 
-Transport: Server class uses poll() to manage sockets.
+Transport: Server class uses an EventBackend to manage sockets.
 
 State Machine: Client class tracks if we are reading or writing.
 
@@ -24,60 +27,164 @@ Logic: Response class finds the file and builds the output.
 
 */
 
-Request::Request(const std::string& raw_data) {
-    std::string data = raw_data;
-    size_t pos = data.find("\r\n\r\n");
-    
-    // 1. Separate Headers from Body
-    std::string head_part = (pos != std::string::npos) ? data.substr(0, pos) : data;
-    if (pos != std::string::npos)
-        _body = data.substr(pos + 4);
-
-    // 2. Process Header Part line by line
-    std::stringstream ss(head_part);
-    std::string line;
-    
-    // First line is the Request Line (GET /index.html HTTP/1.1)
-    if (std::getline(ss, line)) {
-        if (!line.empty() && line[line.size() - 1] == '\r')
-            line.erase(line.size() - 1);
-        _parse_request_line(line);
+static const size_t kMaxHeaderFields = 100;
+
+Request::Request() : _buf(NULL), _body_off(0), _body_len(0) {}
+
+void Request::reset() {
+    _buf = NULL;
+    _method.clear();
+    _path.clear();
+    _version.clear();
+    _fields.clear();
+    _body_off = 0;
+    _body_len = 0;
+}
+
+bool Request::parse(const std::string &buffer, size_t header_end) {
+    reset();
+    _buf = &buffer;
+
+    // Walk the header block line by line without copying it
+    size_t pos = 0;
+    bool first = true;
+    while (pos < header_end) {
+        size_t eol = buffer.find('\n', pos);
+        if (eol == std::string::npos || eol > header_end) {
+            eol = header_end;
+        }
+        size_t len = eol - pos;
+        if (len > 0 && buffer[pos + len - 1] == '\r') {
+            --len;
+        }
+        if (len == 0) {
+            if (first) {
+                pos = eol + 1; // Tolerate a stray CRLF before the request line
+                continue;
+            }
+            break;
+        }
+        if (first) {
+            if (!_parse_request_line(pos, len)) {
+                return false;
+            }
+            first = false;
+        } else if (!_parse_header_line(pos, len)) {
+            return false;
+        }
+        pos = eol + 1;
     }
+    return !first;
+}
 
-    // Subsequent lines are Headers
-    while (std::getline(ss, line) && line != "\r" && !line.empty()) {
-        if (line[line.size() - 1] == '\r')
-            line.erase(line.size() - 1);
-        _parse_header_line(line);
+bool Request::_parse_request_line(size_t off, size_t len) {
+    const char *line = _buf->data() + off;
+    std::string *parts[3] = {&_method, &_path, &_version};
+    size_t i = 0;
+    for (size_t p = 0; p < 3; ++p) {
+        while (i < len && line[i] == ' ') ++i;
+        size_t start = i;
+        while (i < len && line[i] != ' ') ++i;
+        if (start == i) {
+            return false;
+        }
+        parts[p]->assign(line + start, i - start);
     }
+    while (i < len && line[i] == ' ') ++i;
+    return i == len && _version.compare(0, 5, "HTTP/") == 0;
 }
 
-void Request::_parse_request_line(std::string line) {
-    std::stringstream ss(line);
-    ss >> _method >> _path >> _version;
+bool Request::_parse_header_line(size_t off, size_t len) {
+    const char *line = _buf->data() + off;
+    const char *colon = static_cast<const char *>(std::memchr(line, ':', len));
+    if (!colon || colon == line || _fields.size() >= kMaxHeaderFields) {
+        return false;
+    }
+    size_t name_len = colon - line;
+    size_t value_start = name_len + 1;
+    size_t value_end = len;
+    // Trim optional whitespace around the value
+    while (value_start < value_end && (line[value_start] == ' ' || line[value_start] == '\t')) ++value_start;
+    while (value_end > value_start && (line[value_end - 1] == ' ' || line[value_end - 1] == '\t')) --value_end;
+
+    Field field;
+    field.name_off = off;
+    field.name_len = name_len;
+    field.value_off = off + value_start;
+    field.value_len = value_end - value_start;
+    _fields.push_back(field);
+    return true;
+}
+
+void Request::set_body(size_t offset, size_t length) {
+    _body_off = offset;
+    _body_len = length;
 }
 
-void Request::_parse_header_line(std::string line) {
-    size_t colon_pos = line.find(':');
-    if (colon_pos != std::string::npos) {
-        std::string key = line.substr(0, colon_pos);
-        std::string value = line.substr(colon_pos + 1);
-        
-        // Trim leading space from value
-        size_t first = value.find_first_not_of(' ');
-        if (first != std::string::npos)
-            value = value.substr(first);
-            
-        _headers[key] = value;
+const Request::Field* Request::_find(const char *name) const {
+    if (!_buf) {
+        return NULL;
+    }
+    size_t name_len = std::strlen(name);
+    const char *data = _buf->data();
+    for (size_t i = 0; i < _fields.size(); ++i) {
+        if (_fields[i].name_len == name_len
+                && strncasecmp(data + _fields[i].name_off, name, name_len) == 0) {
+            return &_fields[i];
+        }
     }
+    return NULL;
+}
+
+bool Request::header_has_token(const char *key, const char *token) const {
+    const Field *field = _find(key);
+    if (!field) {
+        return false;
+    }
+    const char *value = _buf->data() + field->value_off;
+    size_t token_len = std::strlen(token);
+    size_t i = 0;
+    while (i < field->value_len) {
+        while (i < field->value_len && (value[i] == ' ' || value[i] == '\t' || value[i] == ',')) ++i;
+        size_t start = i;
+        while (i < field->value_len && value[i] != ',' && value[i] != ';') ++i;
+        size_t end = i;
+        while (end > start && (value[end - 1] == ' ' || value[end - 1] == '\t')) --end;
+        if (end - start == token_len && strncasecmp(value + start, token, token_len) == 0) {
+            return true;
+        }
+        while (i < field->value_len && value[i] != ',') ++i; // Skip parameters
+    }
+    return false;
 }
 
 // Getters implementation
 const std::string& Request::get_method() const { return _method; }
 const std::string& Request::get_path() const { return _path; }
-const std::string& Request::get_body() const { return _body; }
-const std::string& Request::get_header(const std::string& key) const {
-    static std::string empty = "";
-    std::map<std::string, std::string>::const_iterator it = _headers.find(key);
-    return (it != _headers.end()) ? it->second : empty;
-}
\ No newline at end of file
+const std::string& Request::get_version() const { return _version; }
+bool Request::has_header(const char *key) const { return _find(key) != NULL; }
+
+std::string Request::get_header(const char *key) const {
+    const Field *field = _find(key);
+    if (!field) {
+        return std::string();
+    }
+    return std::string(_buf->data() + field->value_off, field->value_len);
+}
+
+const char* Request::get_header_ref(const char *key, size_t &len) const {
+    const Field *field = _find(key);
+    if (!field) {
+        len = 0;
+        return NULL;
+    }
+    len = field->value_len;
+    return _buf->data() + field->value_off;
+}
+
+const char* Request::body_data() const {
+    if (!_buf || _body_len == 0) {
+        return "";
+    }
+    return _buf->data() + _body_off;
+}
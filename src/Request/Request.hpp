@@ -10,6 +10,7 @@
 /*                                                                            */
 /* ************************************************************************** */
 
+
 #ifndef REQUEST_HPP
 #define REQUEST_HPP
 
@@ -19,26 +20,51 @@
 #include <sstream>
 #include <iostream>
 
+// Parsed once, when the end of the header block is found. Header names,
+// values and the body are kept as offsets into the client's receive buffer
+// so nothing is copied per header; only the request line is materialized.
 class Request {
 private:
+    struct Field {
+        size_t  name_off;
+        size_t  name_len;
+        size_t  value_off;
+        size_t  value_len;
+    };
+
+    const std::string                   *_buf;     // Client::request_buffer
     std::string                         _method;
     std::string                         _path;
     std::string                         _version;
-    std::map<std::string, std::string>  _headers;
-    std::string                         _body;
+    std::vector<Field>                  _fields;   // Cleared, not freed, between requests
+    size_t                              _body_off;
+    size_t                              _body_len;
 
-    void _parse_request_line(std::string line);
-    void _parse_header_line(std::string line);
+    bool _parse_request_line(size_t off, size_t len);
+    bool _parse_header_line(size_t off, size_t len);
+    const Field* _find(const char *name) const;
 
 public:
-    Request(const std::string& raw_data);
+    Request();
     ~Request() {}
 
+    // Parses [0, header_end) of 'buffer'; false means a malformed request
+    bool    parse(const std::string &buffer, size_t header_end);
+    void    set_body(size_t offset, size_t length);
+    void    reset();
+
     // Getters
     const std::string& get_method() const;
     const std::string& get_path() const;
-    const std::string& get_header(const std::string& key) const;
-    const std::string& get_body() const;
+    const std::string& get_version() const;
+    std::string        get_header(const char *key) const;
+    // Points into the receive buffer, NULL when the header is absent
+    const char*        get_header_ref(const char *key, size_t &len) const;
+    bool               has_header(const char *key) const;
+    // Case-insensitive search for 'token' in a comma separated header value
+    bool               header_has_token(const char *key, const char *token) const;
+    const char*        body_data() const;
+    size_t             body_size() const { return _body_len; }
 };
 
-#endif
\ No newline at end of file
+#endif
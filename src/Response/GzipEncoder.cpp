@@ -0,0 +1,107 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   GzipEncoder.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "GzipEncoder.hpp"
+
+GzipEncoder::GzipEncoder() : _open(false) {}
+
+GzipEncoder::~GzipEncoder() {
+    reset();
+}
+
+void GzipEncoder::reset() {
+#ifdef WEBSERV_ZLIB
+    if (_open) {
+        deflateEnd(&_stream);
+        _open = false;
+    }
+#endif
+}
+
+#ifdef WEBSERV_ZLIB
+
+bool GzipEncoder::available() {
+    return true;
+}
+
+bool GzipEncoder::begin(int level) {
+    if (_open) {
+        deflateEnd(&_stream);
+        _open = false;
+    }
+    _stream.zalloc = Z_NULL;
+    _stream.zfree = Z_NULL;
+    _stream.opaque = Z_NULL;
+    // 15 window bits plus 16 asks zlib for a gzip header and trailer
+    if (deflateInit2(&_stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    _open = true;
+    return true;
+}
+
+bool GzipEncoder::_deflate(const char *data, size_t len, int flush, std::string &out) {
+    if (!_open) {
+        return false;
+    }
+    char chunk[16384];
+    _stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    _stream.avail_in = static_cast<uInt>(len);
+    int status;
+    do {
+        _stream.next_out = reinterpret_cast<Bytef*>(chunk);
+        _stream.avail_out = sizeof(chunk);
+        status = deflate(&_stream, flush);
+        if (status == Z_STREAM_ERROR) {
+            return false;
+        }
+        out.append(chunk, sizeof(chunk) - _stream.avail_out);
+    } while (_stream.avail_out == 0 || (flush == Z_FINISH && status != Z_STREAM_END));
+    return true;
+}
+
+bool GzipEncoder::update(const char *data, size_t len, std::string &out) {
+    return _deflate(data, len, Z_NO_FLUSH, out);
+}
+
+bool GzipEncoder::finish(std::string &out) {
+    bool ok = _deflate(NULL, 0, Z_FINISH, out);
+    if (_open) {
+        deflateEnd(&_stream);
+        _open = false;
+    }
+    return ok;
+}
+
+#else
+
+bool GzipEncoder::available() {
+    return false;
+}
+
+bool GzipEncoder::begin(int) {
+    return false;
+}
+
+bool GzipEncoder::_deflate(const char *, size_t, int, std::string &) {
+    return false;
+}
+
+bool GzipEncoder::update(const char *, size_t, std::string &) {
+    return false;
+}
+
+bool GzipEncoder::finish(std::string &) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,51 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   GzipEncoder.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef GZIP_ENCODER_HPP
+#define GZIP_ENCODER_HPP
+
+#include <string>
+#ifdef WEBSERV_ZLIB
+# include <zlib.h>
+#endif
+
+// Incremental gzip (RFC 1952) over zlib's deflate. Input is fed in pieces
+// and the compressed bytes appended to the caller's string, so the whole
+// uncompressed file never has to sit in memory. Without zlib (make ZLIB=0)
+// begin() fails and callers fall back to identity bodies.
+class GzipEncoder {
+private:
+#ifdef WEBSERV_ZLIB
+    z_stream    _stream;
+#endif
+    bool        _open;
+
+    GzipEncoder(const GzipEncoder &);
+    GzipEncoder &operator=(const GzipEncoder &);
+
+    bool    _deflate(const char *data, size_t len, int flush, std::string &out);
+
+public:
+    GzipEncoder();
+    ~GzipEncoder();
+
+    static bool available();
+
+    bool    begin(int level);
+    bool    update(const char *data, size_t len, std::string &out);
+    // Flushes the trailer; the encoder can then begin() again
+    bool    finish(std::string &out);
+    // Drops an unfinished stream
+    void    reset();
+};
+
+#endif
@@ -1,12 +1,25 @@
 #include "Response.hpp"
+#include "GzipEncoder.hpp"
 #include <dirent.h>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <strings.h>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-Response::Response(const Request& req, const ServerConfig &config, const RouteConfig &route)
-    : _content_type("text/html"), _config(config), _route(route) {
+const int Response::kGzipLevel;
+
+Response::Response(const Request& req, const ServerConfig &config, const RouteConfig &route, bool keep_alive)
+    : _content_type("text/html"), _config(config), _route(route), _keep_alive(keep_alive),
+      _file_fd(-1), _file_size(0), _vary(false), _gzip_wanted(false), _not_modified(false),
+      _chunked(false) {
     std::string root = _route.root.empty() ? _config.root : _route.root;
     std::string index = _route.index.empty() ? _config.index : _route.index;
     bool autoindex = _route.autoindex_set ? _route.autoindex : _config.autoindex;
@@ -42,14 +55,8 @@ Response::Response(const Request& req, const ServerConfig &config, const RouteCo
                 full_path += "/";
             }
             std::string index_path = full_path + index;
-            std::ifstream index_file(index_path.c_str(), std::ios::binary);
-            if (index_file.is_open()) {
-                _status_line = "HTTP/1.1 200 OK\r\n";
-                std::stringstream ss;
-                ss << index_file.rdbuf();
-                _body = ss.str();
-                _content_type = _detect_content_type(index_path);
-                index_file.close();
+            if (_serve_file(req, index_path)) {
+                // 200 or 304, set by _serve_file
             } else if (autoindex) {
                 _status_line = "HTTP/1.1 200 OK\r\n";
                 _build_autoindex(full_path, request_path);
@@ -58,45 +65,507 @@ Response::Response(const Request& req, const ServerConfig &config, const RouteCo
                 _build_error_page(403, "Forbidden");
             }
         } else {
-            // 3. Try to open the file
-            std::ifstream file(full_path.c_str(), std::ios::binary);
-            if (file.is_open()) {
-                _status_line = "HTTP/1.1 200 OK\r\n";
-                std::stringstream ss;
-                ss << file.rdbuf();
-                _body = ss.str();
-                _content_type = _detect_content_type(full_path);
-                file.close();
-            } else {
+            // 3. Try to open the file, the body itself is streamed later
+            if (!_serve_file(req, full_path)) {
                 _build_error_page(404, "Not Found");
             }
         }
     }
 
     // 4. Assemble the final response
-    std::stringstream res;
-    res << _status_line;
-    res << _headers;
-    res << "Content-Type: " << _content_type << "\r\n";
-    res << "Content-Length: " << _body.size() << "\r\n";
-    res << "Connection: close\r\n";
-    res << "\r\n";
-    res << _body;
-
-    _full_response = res.str();
+    _assemble();
 }
 
-Response::Response(int code, const std::string &message, const ServerConfig &config, const RouteConfig &route)
-    : _content_type("text/html"), _config(config), _route(route) {
+Response::Response(int code, const std::string &message, const ServerConfig &config, const RouteConfig &route,
+                   bool keep_alive)
+    : _content_type("text/html"), _config(config), _route(route), _keep_alive(keep_alive),
+      _file_fd(-1), _file_size(0), _vary(false), _gzip_wanted(false), _not_modified(false),
+      _chunked(false) {
     _build_error_page(code, message);
-    std::stringstream res;
-    res << _status_line;
-    res << "Content-Type: " << _content_type << "\r\n";
-    res << "Content-Length: " << _body.size() << "\r\n";
-    res << "Connection: close\r\n";
-    res << "\r\n";
-    res << _body;
-    _full_response = res.str();
+    _assemble();
+}
+
+Response::~Response() {
+    if (_file_fd != -1) {
+        close(_file_fd);
+    }
+}
+
+// File bodies are not read here: only the header is built in memory and
+// the caller streams the body from the fd with sendfile(). The variant and
+// its validators come from stat() alone, so a revalidation answered with
+// 304 never opens the file.
+bool Response::_serve_file(const Request &req, const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    _file_path = path;
+    _file_stat = st;
+    _file_size = static_cast<off_t>(st.st_size);
+    _body.clear();
+    _content_type = _detect_content_type(path);
+    std::string body_path = path;
+    _negotiate_encoding(req, body_path);
+
+    // A client holding the plain file keeps it even when gzip is wanted
+    std::string etag = make_etag(st, _encoding.empty() && _gzip_wanted ? "gzip" : _encoding);
+    if (not_modified(req, etag, st.st_mtime, make_etag(st, ""))) {
+        _status_line = "HTTP/1.1 304 Not Modified\r\n";
+        _not_modified = true;
+        if (_encoding.empty() && _gzip_wanted && !not_modified(req, make_etag(st, ""), st.st_mtime)) {
+            _encoding = "gzip"; // Only picks the tag: a 304 has no body to encode
+        }
+        _gzip_wanted = false;
+        return true;
+    }
+
+    int fd = open(body_path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat opened;
+    if (fd >= 0 && (fstat(fd, &opened) < 0 || !S_ISREG(opened.st_mode))) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) {
+        _file_path.clear();
+        _encoding.clear();
+        _vary = false;
+        _gzip_wanted = false;
+        return false;
+    }
+    // The file may have been replaced since stat(): describe what is sent
+    _file_fd = fd;
+    _file_size = static_cast<off_t>(opened.st_size);
+    if (_encoding.empty()) {
+        _file_stat = opened;
+    } else {
+        _sidecar_path = body_path;
+        _sidecar_stat = opened;
+    }
+    _status_line = "HTTP/1.1 200 OK\r\n";
+    _apply_range(req);
+    return true;
+}
+
+int Response::release_file_fd() {
+    int fd = _file_fd;
+    _file_fd = -1;
+    return fd;
+}
+
+static const size_t kMaxRanges = 16; // More parts than this and Range is ignored
+
+static std::string trim_spaces(const std::string &value) {
+    size_t start = value.find_first_not_of(" \t");
+    if (start == std::string::npos) {
+        return "";
+    }
+    return value.substr(start, value.find_last_not_of(" \t") - start + 1);
+}
+
+// q-value the Accept-Encoding list gives 'coding', 0 when refused or absent
+static double coding_quality(const std::string &header, const char *coding) {
+    double any = 0;
+    size_t pos = 0;
+    while (pos < header.size()) {
+        size_t end = header.find(',', pos);
+        if (end == std::string::npos) {
+            end = header.size();
+        }
+        std::string item = header.substr(pos, end - pos);
+        pos = end + 1;
+        size_t semi = item.find(';');
+        std::string name = trim_spaces(item.substr(0, semi));
+        double q = 1.0;
+        if (semi != std::string::npos) {
+            size_t qpos = item.find("q=", semi);
+            if (qpos != std::string::npos) {
+                q = std::strtod(item.c_str() + qpos + 2, NULL);
+            }
+        }
+        if (strcasecmp(name.c_str(), coding) == 0) {
+            return q;
+        }
+        if (name == "*") {
+            any = q;
+        }
+    }
+    return any;
+}
+
+// br only ever comes from a sidecar; gzip from a sidecar or the encoder
+std::string Response::accepted_encodings(const Request &req, const ServerConfig &config) {
+    if (!config.gzip_static && !config.gzip) {
+        return "";
+    }
+    std::string header = req.get_header("Accept-Encoding");
+    double br = config.gzip_static ? coding_quality(header, "br") : 0;
+    double gzip = coding_quality(header, "gzip");
+    std::string result;
+    if (br > 0 && br >= gzip) {
+        result = "br";
+    }
+    if (gzip > 0) {
+        result += result.empty() ? "gzip" : ",gzip";
+    }
+    if (br > 0 && br < gzip) {
+        result += ",br";
+    }
+    return result;
+}
+
+// Picks the body for the client: a fresh precompressed sidecar when one
+// exists, otherwise the plain file, flagged for on-the-fly gzip if allowed
+void Response::_negotiate_encoding(const Request &req, std::string &body_path) {
+    bool compressible = std::find(_config.gzip_types.begin(), _config.gzip_types.end(), _content_type)
+                        != _config.gzip_types.end();
+    _vary = _config.gzip_static || (_config.gzip && compressible);
+    std::string accepted = accepted_encodings(req, _config);
+    size_t pos = 0;
+    while (_config.gzip_static && pos < accepted.size()) {
+        size_t end = accepted.find(',', pos);
+        if (end == std::string::npos) {
+            end = accepted.size();
+        }
+        if (_find_sidecar(accepted.substr(pos, end - pos), body_path)) {
+            return;
+        }
+        pos = end + 1;
+    }
+    _gzip_wanted = _config.gzip && compressible && accepted.find("gzip") != std::string::npos
+                   && static_cast<size_t>(_file_size) >= _config.gzip_min_length;
+}
+
+// A sidecar older than its file is stale and ignored
+bool Response::_find_sidecar(const std::string &coding, std::string &body_path) {
+    std::string path = _file_path + (coding == "br" ? ".br" : ".gz");
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode) || st.st_mtime < _file_stat.st_mtime) {
+        _skipped_sidecars.push_back(path);
+        return false;
+    }
+    body_path = path;
+    _file_size = static_cast<off_t>(st.st_size);
+    _encoding = coding;
+    return true;
+}
+
+std::string Response::make_etag(const struct stat &st, const std::string &encoding) {
+    std::stringstream tag;
+    if (!encoding.empty()) {
+        tag << "W/";
+    }
+    tag << '"' << std::hex << st.st_ino << '-' << st.st_size << '-' << st.st_mtime;
+    if (!encoding.empty()) {
+        tag << '-' << encoding;
+    }
+    tag << '"';
+    return tag.str();
+}
+
+std::string Response::http_date(time_t when) {
+    struct tm tm;
+    char buffer[64];
+    gmtime_r(&when, &tm);
+    strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buffer;
+}
+
+// Weak comparison: W/ prefixes do not matter
+static bool etag_listed(const std::string &header, const std::string &etag) {
+    std::string opaque = etag.compare(0, 2, "W/") == 0 ? etag.substr(2) : etag;
+    size_t pos = 0;
+    while (pos < header.size()) {
+        size_t end = header.find(',', pos);
+        if (end == std::string::npos) {
+            end = header.size();
+        }
+        std::string item = trim_spaces(header.substr(pos, end - pos));
+        pos = end + 1;
+        if (item.compare(0, 2, "W/") == 0) {
+            item.erase(0, 2);
+        }
+        if (item == "*" || (!opaque.empty() && item == opaque)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Response::not_modified(const Request &req, const std::string &etag, time_t mtime,
+                            const std::string &alt_etag) {
+    if (req.has_header("If-None-Match")) {
+        std::string header = req.get_header("If-None-Match");
+        return etag_listed(header, etag) || (!alt_etag.empty() && etag_listed(header, alt_etag));
+    }
+    if (!req.has_header("If-Modified-Since")) {
+        return false;
+    }
+    std::string since = req.get_header("If-Modified-Since");
+    struct tm tm;
+    std::memset(&tm, 0, sizeof(tm));
+    if (!strptime(since.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm)) {
+        return false; // Unparsable dates are ignored, as RFC 9110 asks
+    }
+    return mtime <= timegm(&tm);
+}
+
+std::string Response::get_validators() const {
+    if (_file_path.empty()) {
+        return "";
+    }
+    std::string lines = "ETag: " + get_etag() + "\r\n";
+    lines += "Last-Modified: " + http_date(_file_stat.st_mtime) + "\r\n";
+    if (_vary) {
+        lines += "Vary: Accept-Encoding\r\n";
+    }
+    return lines;
+}
+
+// Saturates instead of overflowing: no file is that large anyway
+static off_t parse_offset(const std::string &digits) {
+    off_t value = 0;
+    for (size_t i = 0; i < digits.size(); ++i) {
+        if (value > 100000000000000000LL) {
+            return 1000000000000000000LL;
+        }
+        value = value * 10 + (digits[i] - '0');
+    }
+    return value;
+}
+
+static bool all_digits(const std::string &value) {
+    return value.find_first_not_of("0123456789") == std::string::npos;
+}
+
+// "bytes=0-99, 200-, -50" against a file of 'size' bytes. False means the
+// header is malformed and ignored; otherwise the satisfiable ranges, as
+// (first, last) pairs, land in 'ranges' and may be none.
+static bool parse_byte_ranges(const std::string &header, off_t size,
+                              std::vector<std::pair<off_t, off_t> > &ranges) {
+    std::string value = trim_spaces(header);
+    if (value.compare(0, 6, "bytes=") != 0) {
+        return false;
+    }
+    size_t specs = 0;
+    size_t pos = 6;
+    while (pos <= value.size()) {
+        size_t end = value.find(',', pos);
+        if (end == std::string::npos) {
+            end = value.size();
+        }
+        std::string spec = trim_spaces(value.substr(pos, end - pos));
+        pos = end + 1;
+        if (spec.empty()) {
+            continue;
+        }
+        size_t dash = spec.find('-');
+        if (++specs > kMaxRanges || dash == std::string::npos) {
+            return false;
+        }
+        std::string first = spec.substr(0, dash);
+        std::string last = spec.substr(dash + 1);
+        if (!all_digits(first) || !all_digits(last) || (first.empty() && last.empty())) {
+            return false;
+        }
+        off_t start;
+        off_t stop = size - 1;
+        if (first.empty()) {
+            // Suffix: the final N bytes
+            off_t suffix = parse_offset(last);
+            if (suffix == 0) {
+                continue;
+            }
+            start = suffix >= size ? 0 : size - suffix;
+        } else {
+            start = parse_offset(first);
+            if (!last.empty()) {
+                off_t bound = parse_offset(last);
+                if (bound < start) {
+                    return false;
+                }
+                stop = std::min(bound, size - 1);
+            }
+        }
+        if (start < size) {
+            ranges.push_back(std::make_pair(start, stop));
+        }
+    }
+    return specs > 0;
+}
+
+// An entity tag must match strongly; a date must be the exact Last-Modified
+bool Response::_if_range_matches(const std::string &value) const {
+    std::string validator = trim_spaces(value);
+    if (validator.compare(0, 2, "W/") == 0) {
+        return false;
+    }
+    if (!validator.empty() && validator[0] == '"') {
+        std::string etag = get_etag();
+        return etag.compare(0, 2, "W/") != 0 && etag == validator;
+    }
+    return validator == http_date(_file_stat.st_mtime);
+}
+
+// Turns the open 200 file response into a 206 or a 416 when the request
+// asks for ranges. Range is ignored, and the whole file sent, when it is
+// malformed, when If-Range does not hold, or when the parts add up to more
+// than the file itself.
+void Response::_apply_range(const Request &req) {
+    if (!req.has_header("Range")) {
+        return;
+    }
+    if (req.has_header("If-Range") && !_if_range_matches(req.get_header("If-Range"))) {
+        return;
+    }
+    std::vector<std::pair<off_t, off_t> > ranges;
+    if (!parse_byte_ranges(req.get_header("Range"), _file_size, ranges)) {
+        return;
+    }
+    std::stringstream content_range;
+    if (ranges.empty()) {
+        off_t size = _file_size;
+        close(_file_fd);
+        _file_fd = -1;
+        _file_path.clear();
+        _encoding.clear();
+        _vary = false;
+        _gzip_wanted = false;
+        _build_error_page(416, "Range Not Satisfiable");
+        content_range << "Content-Range: bytes */" << size << "\r\n";
+        _headers += content_range.str();
+        return;
+    }
+    off_t total = 0;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        total += ranges[i].second - ranges[i].first + 1;
+    }
+    if (total > _file_size) {
+        return; // Overlapping parts would amplify the transfer
+    }
+    _gzip_wanted = false; // Parts are cut from the bytes as stored
+    _status_line = "HTTP/1.1 206 Partial Content\r\n";
+    if (ranges.size() == 1) {
+        ByteRange range;
+        range.start = ranges[0].first;
+        range.length = ranges[0].second - ranges[0].first + 1;
+        _ranges.push_back(range);
+        content_range << "Content-Range: bytes " << ranges[0].first << '-' << ranges[0].second
+                      << '/' << _file_size << "\r\n";
+        _headers += content_range.str();
+        return;
+    }
+    static unsigned long sequence = 0;
+    std::stringstream boundary;
+    boundary << std::hex << std::setfill('0') << std::setw(8) << static_cast<unsigned long>(time(NULL))
+             << std::setw(8) << ++sequence << std::setw(8) << static_cast<unsigned long>(_file_stat.st_ino);
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        std::stringstream part;
+        part << "\r\n--" << boundary.str() << "\r\n";
+        part << "Content-Type: " << _content_type << "\r\n";
+        part << "Content-Range: bytes " << ranges[i].first << '-' << ranges[i].second << '/' << _file_size
+             << "\r\n\r\n";
+        ByteRange range;
+        range.start = ranges[i].first;
+        range.length = ranges[i].second - ranges[i].first + 1;
+        range.head = part.str();
+        _ranges.push_back(range);
+    }
+    _ranges_tail = "\r\n--" + boundary.str() + "--\r\n";
+    _content_type = "multipart/byteranges; boundary=" + boundary.str();
+}
+
+off_t Response::_content_length() const {
+    if (_ranges.empty()) {
+        return _file_size;
+    }
+    off_t length = static_cast<off_t>(_ranges_tail.size());
+    for (size_t i = 0; i < _ranges.size(); ++i) {
+        length += static_cast<off_t>(_ranges[i].head.size()) + _ranges[i].length;
+    }
+    return length;
+}
+
+bool Response::gzip_file_body() {
+    if (!wants_gzip()) {
+        return false;
+    }
+    GzipEncoder gzip;
+    if (!gzip.begin(kGzipLevel)) {
+        return false;
+    }
+    std::string compressed;
+    char chunk[65536];
+    off_t offset = 0;
+    while (offset < _file_size) {
+        ssize_t bytes = pread(_file_fd, chunk, sizeof(chunk), offset);
+        if (bytes <= 0 || !gzip.update(chunk, static_cast<size_t>(bytes), compressed)) {
+            return false;
+        }
+        offset += bytes;
+    }
+    if (!gzip.finish(compressed)) {
+        return false;
+    }
+    close(_file_fd);
+    _file_fd = -1;
+    _body.swap(compressed);
+    _encoding = "gzip";
+    _gzip_wanted = false;
+    _assemble();
+    return true;
+}
+
+void Response::chunk_gzip_body() {
+    _encoding = "gzip";
+    _gzip_wanted = false;
+    _chunked = true;
+    _assemble();
+}
+
+bool Response::read_body(std::string &out) const {
+    if (_file_fd == -1) {
+        out = _body;
+        return true;
+    }
+    out.resize(static_cast<size_t>(_file_size));
+    size_t done = 0;
+    while (done < out.size()) {
+        ssize_t bytes = pread(_file_fd, &out[done], out.size() - done, static_cast<off_t>(done));
+        if (bytes <= 0) {
+            return false;
+        }
+        done += bytes;
+    }
+    return true;
+}
+
+void Response::_assemble() {
+    std::stringstream head;
+    head << _status_line;
+    head << _headers;
+    head << get_validators();
+    if (_not_modified) {
+        _head = head.str(); // No body, so no Content-Type or Content-Length
+        return;
+    }
+    head << "Content-Type: " << _content_type << "\r\n";
+    if (!_encoding.empty()) {
+        head << "Content-Encoding: " << _encoding << "\r\n";
+    }
+    if (_chunked) {
+        head << "Transfer-Encoding: chunked\r\n";
+    } else if (_file_fd != -1) {
+        head << "Accept-Ranges: bytes\r\n";
+        head << "Content-Length: " << _content_length() << "\r\n";
+    } else {
+        head << "Content-Length: " << _body.size() << "\r\n";
+    }
+    _head = head.str();
+}
+
+const char* Response::get_connection_header() const {
+    return _keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
 }
 
 void Response::_build_error_page(int code, const std::string &message) {
@@ -164,5 +633,7 @@ std::string Response::_detect_content_type(const std::string &path) const {
     if (ext == "gif") return "image/gif";
     if (ext == "ico") return "image/x-icon";
     if (ext == "txt") return "text/plain";
+    if (ext == "json") return "application/json";
+    if (ext == "svg") return "image/svg+xml";
     return "application/octet-stream";
 }
@@ -14,18 +14,57 @@
 #define RESPONSE_HPP
 
 #include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include "Request.hpp"
 #include "Config.hpp"
 
 class Response {
+public:
+    static const int kGzipLevel = 6;    // zlib's default speed/ratio balance
+
+    // Part of a 206 body, sent straight from the file
+    struct ByteRange {
+        off_t       start;
+        off_t       length;
+        std::string head;       // multipart/byteranges part header, empty for one range
+    };
+
 private:
-    std::string _full_response;
     std::string _body;
     std::string _status_line;
     std::string _headers;
     std::string _content_type;
-    ServerConfig _config;
-    RouteConfig _route;
+    const ServerConfig &_config;
+    const RouteConfig &_route;
+    bool        _keep_alive;
+    std::string _head;        // Status line and headers, without Connection
+    int         _file_fd;     // Open body file, streamed by the server
+    off_t       _file_size;
+    std::string _file_path;   // Always the plain file, even when a sidecar is sent
+    struct stat _file_stat;
+    std::string _sidecar_path; // Precompressed file the body is read from, if any
+    struct stat _sidecar_stat;
+    std::vector<std::string> _skipped_sidecars; // Looked for, but missing or stale
+    std::string _encoding;    // Content-Encoding of the body, empty for identity
+    bool        _vary;        // Body depends on Accept-Encoding
+    bool        _gzip_wanted; // Client takes gzip and the file is worth compressing
+    bool        _not_modified; // 304: validators only, no body
+    bool        _chunked;     // Body compressed by the server while sending
+    std::vector<ByteRange> _ranges; // 206 parts, empty for the whole file
+    std::string _ranges_tail;  // Closing multipart boundary
+
+    Response(const Response &);
+    Response &operator=(const Response &);
+
+    void _assemble();
+    bool _serve_file(const Request &req, const std::string &path);
+    void _negotiate_encoding(const Request &req, std::string &body_path);
+    bool _find_sidecar(const std::string &coding, std::string &body_path);
+    void _apply_range(const Request &req);
+    bool _if_range_matches(const std::string &value) const;
+    off_t _content_length() const;
 
     void _build_error_page(int code, const std::string &message);
     void _build_autoindex(const std::string &full_path, const std::string &request_path);
@@ -33,11 +72,58 @@ private:
     bool _try_load_error_page(int code);
 
 public:
-    Response(const Request& req, const ServerConfig &config, const RouteConfig &route);
-    Response(int code, const std::string &message, const ServerConfig &config, const RouteConfig &route);
-    ~Response() {}
+    Response(const Request& req, const ServerConfig &config, const RouteConfig &route, bool keep_alive = false);
+    Response(int code, const std::string &message, const ServerConfig &config, const RouteConfig &route,
+             bool keep_alive = false);
+    ~Response();
+
+    // The head is followed by the Connection line, then the body: in memory
+    // (take_body) or streamed from the file (release_file_fd)
+    const char* get_connection_header() const;
+    void    take_body(std::string &out) { out.swap(_body); }
+    bool    has_file_body() const { return _file_fd != -1; }
+    off_t   get_file_size() const { return _file_size; }
+    // Hands the body fd over to the caller, who becomes responsible for closing it
+    int     release_file_fd();
+    // Non-empty for a 206: send each part's head, then its file range,
+    // then the tail
+    const std::vector<ByteRange>&   get_ranges() const { return _ranges; }
+    const std::string&              get_ranges_tail() const { return _ranges_tail; }
+
+    // Pieces the static cache needs to store this response
+    const std::string&  get_head() const { return _head; }
+    const std::string&  get_file_path() const { return _file_path; }
+    const struct stat&  get_file_stat() const { return _file_stat; }
+    const std::string&  get_sidecar_path() const { return _sidecar_path; }
+    const struct stat&  get_sidecar_stat() const { return _sidecar_stat; }
+    // Sidecars that would have been preferred over the chosen body
+    const std::vector<std::string>& get_skipped_sidecars() const { return _skipped_sidecars; }
+    // The body bytes, read from the file when there is one
+    bool                read_body(std::string &out) const;
+
+    // ETag, Last-Modified and Vary lines of a file response; a 304 for
+    // the same file repeats them
+    std::string         get_validators() const;
+    std::string         get_etag() const { return make_etag(_file_stat, _encoding); }
+
+    // Strong for the plain file, weak for compressed variants
+    static std::string  make_etag(const struct stat &st, const std::string &encoding);
+    static std::string  http_date(time_t when);
+    // If-None-Match (weak comparison, 'etag' or 'alt_etag') or else
+    // If-Modified-Since against 'mtime'
+    static bool         not_modified(const Request &req, const std::string &etag, time_t mtime,
+                                     const std::string &alt_etag = "");
 
-    const std::string& get_raw_response() const { return _full_response; }
+    // Codings this server could answer with for the request, best first
+    // ("br,gzip", "gzip", ...); part of the static cache key
+    static std::string  accepted_encodings(const Request &req, const ServerConfig &config);
+    bool    wants_gzip() const { return _gzip_wanted && _file_fd != -1; }
+    // Compresses the file into memory and drops the fd; false keeps the
+    // plain file body
+    bool    gzip_file_body();
+    // Announces a gzip body the server compresses from the file fd as it
+    // sends, chunked since its length is only known at the end
+    void    chunk_gzip_body();
 };
 
 #endif
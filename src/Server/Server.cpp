@@ -12,482 +12,1446 @@
 
 #include "Server.hpp"
 #include <cstdlib>
+#include <cerrno>
+#include <algorithm>
+#include <netdb.h>
 
 volatile sig_atomic_t g_shutdown_requested = 0;
 
-Server::Server() {}
+static const size_t kPooledClients = 1024;    // Idle Client objects kept for reuse
+static const msec_t kStatsIntervalMs = 60000;
+static const size_t kReadBudget = 1024 * 1024;  // Per client per wakeup
+static const size_t kAcceptBatch = 64;          // Connections per listener wakeup
+static const char   *kCgiSpoolDir = "/tmp";     // Large CGI bodies without an upload_dir
+static const size_t kCgiHighWater = 256 * 1024; // Queued script output before reads pause
+static const size_t kGzipHighWater = 64 * 1024; // Queued compressed output before deflate waits
+static const size_t kGzipSlice = 64 * 1024;     // File bytes deflated per chunk
+static const msec_t kCgiKillGraceMs = 2000;     // Between SIGTERM and SIGKILL
+static const char   *kBusyBody = "<html><body><h1>503 Service Unavailable</h1></body></html>";
+static const int    kBusyRetryAfter = 5;        // Seconds suggested to clients turned away
+
+Server::Server()
+    : _events(NULL), _reuse_port(false), _upload_seq(0), _now(monotonic_ms()), _timers(_now),
+      _next_stats(_now + kStatsIntervalMs), _fastcgi(*this), _busy_response(NULL) {
+    // Built once: under overload a rejection should cost no file reads
+    std::stringstream head;
+    head << "HTTP/1.1 503 Service Unavailable\r\n";
+    head << "Content-Type: text/html\r\n";
+    head << "Content-Length: " << std::strlen(kBusyBody) << "\r\n";
+    head << "Retry-After: " << kBusyRetryAfter << "\r\n";
+    _busy_response = new SharedBuffer(head.str() + kBusyBody);
+}
 
 Server::~Server() {
     cleanup();
+    _busy_response->release();
+    for (size_t i = 0; i < _route_tables.size(); ++i) {
+        delete _route_tables[i];
+    }
 }
 
 void Server::set_configs(const std::vector<ServerConfig> &configs) {
+    for (size_t i = 0; i < _route_tables.size(); ++i) {
+        delete _route_tables[i];
+    }
+    _route_tables.clear();
     _configs = configs;
+    // Compile each server's locations once; requests only ever read them
+    for (size_t i = 0; i < _configs.size(); ++i) {
+        _route_tables.push_back(new RouteTable(_configs[i]));
+        _configs[i].route_table = _route_tables[i];
+    }
+}
+
+void Server::set_global_config(const GlobalConfig &global) {
+    _global = global;
+    _reuse_port = global.worker_processes != 1;
+    _recv_buffer.resize(global.client_receive_buffer_max);
+    _static_cache.configure(global.static_cache_max_bytes, global.static_cache_max_file_size,
+                            global.static_cache_valid);
+    _cgi_cache.configure(global.cgi_cache_max_bytes, global.cgi_cache_max_entry_size);
 }
 
 void Server::cleanup() {
-    for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
-        close(it->first);
+    _fastcgi.close_all();
+    for (std::map<pid_t, CgiChild*>::iterator it = _children.begin(); it != _children.end(); ++it) {
+        kill(it->first, SIGTERM);
+        _timers.cancel(it->second->timer);
         delete it->second;
     }
+    _children.clear();
+    _reaper.close();
+    for (int fd = 0; fd < _clients.table_size(); ++fd) {
+        Client *c = _clients.client_at(fd);
+        if (!c) {
+            continue;
+        }
+        if (c->cgi_pipe_fd != -1) {
+            close(c->cgi_pipe_fd);
+        }
+        close_cgi_input(*c);
+        close(fd);
+        _timers.cancel(c->timer);
+    }
     _clients.clear();
 
     for (size_t i = 0; i < _listen_fds.size(); ++i) {
         close(_listen_fds[i]);
     }
     _listen_fds.clear();
-    _poll_fds.clear();
-    _cgi_fds.clear();
-    _listener_ports.clear();
+    _listener_by_fd.clear();
+    _listeners.clear();
+    _fd_roles.clear();
+    delete _events;
+    _events = NULL;
 }
 
-void Server::update_poll_events(int fd, short events) {
-    for (size_t i = 0; i < _poll_fds.size(); ++i) {
-        if (_poll_fds[i].fd == fd) {
-            _poll_fds[i].events = static_cast<short>(events | POLLIN);
-            return;
+void Server::_watch(int fd, e_fd_role role, int events) {
+    if (!_events) {
+        _events = EventBackend::create(_global.event_backend);
+    }
+    if (static_cast<size_t>(fd) >= _fd_roles.size()) {
+        _fd_roles.resize(fd + 1, FD_ROLE_NONE);
+    }
+    _fd_roles[fd] = static_cast<char>(role);
+    _events->add(fd, events);
+}
+
+void Server::_unwatch(int fd) {
+    if (_events) {
+        _events->remove(fd);
+    }
+    if (fd >= 0 && static_cast<size_t>(fd) < _fd_roles.size()) {
+        _fd_roles[fd] = FD_ROLE_NONE;
+    }
+}
+
+e_fd_role Server::_role_of(int fd) const {
+    if (fd < 0 || static_cast<size_t>(fd) >= _fd_roles.size()) {
+        return FD_ROLE_NONE;
+    }
+    return static_cast<e_fd_role>(_fd_roles[fd]);
+}
+
+void Server::update_events(int fd, int events) {
+    // Hangups and errors are always reported, whatever the interest set is
+    if (_events) {
+        _events->modify(fd, events);
+    }
+}
+
+bool Server::is_listener(int fd) const {
+    return _role_of(fd) == FD_ROLE_LISTENER;
+}
+
+void Server::close_client(int fd) {
+    Client *c = _clients.client_at(fd);
+    if (!c) {
+        return;
+    }
+    // Drop a CGI pipe still owned by this client so it cannot dangle, and
+    // stop a script nobody will read anymore
+    close_cgi_pipe(*c);
+    std::map<pid_t, CgiChild*>::iterator child = _children.find(c->cgi_pid);
+    if (child != _children.end() && child->second->client_fd == fd) {
+        child->second->client_fd = -1;
+        terminate_child(c->cgi_pid);
+    }
+    _fastcgi.abort(*c);
+    c->close_gzip_body();
+    if (c->cgi_queue) {
+        _cgi_queue.cancel(c->cgi_queue, fd, false);
+        c->cgi_queue = NULL;
+    }
+    if (c->cache_role == CACHE_WAITING) {
+        _cgi_cache.cancel_wait(c->cache_key, fd);
+        c->cache_role = CACHE_NONE;
+    }
+    end_cache_fill(*c, false);
+    std::cout << "Closing connection on FD " << fd << " (" << c->recv_calls << " reads, "
+              << (c->recv_calls ? c->recv_bytes / c->recv_calls : 0) << " bytes avg, window "
+              << c->recv_window << ")" << std::endl;
+    _timers.cancel(c->timer);
+    _unwatch(fd);
+    close(fd);
+    _clients.release(c);
+}
+
+static bool is_ipv6_host(const std::string &host) {
+    return host.find(':') != std::string::npos;
+}
+
+static bool is_wildcard_host(const std::string &host) {
+    return host.empty() || host == "*" || host == "0.0.0.0" || host == "::";
+}
+
+// One socket per distinct (host, port); every server block sharing it
+// goes into that listener's vhost index. A wildcard address already
+// covers the specific ones of its family on that port, so those blocks
+// join it instead of failing to bind.
+void Server::setup_listeners() {
+    for (size_t i = 0; i < _configs.size(); ++i) {
+        const ServerConfig &config = _configs[i];
+        std::string host = config.host;
+        for (size_t j = 0; j < _configs.size(); ++j) {
+            const std::string &other = _configs[j].host;
+            if (_configs[j].port == config.port && is_wildcard_host(other)
+                    && is_ipv6_host(other) == is_ipv6_host(host)) {
+                host = is_ipv6_host(host) ? "::" : "";
+                break;
+            }
+        }
+        size_t id = 0;
+        while (id < _listeners.size()
+                && (_listeners[id].host != host || _listeners[id].port != config.port)) {
+            ++id;
+        }
+        if (id == _listeners.size()) {
+            Listener listener;
+            listener.host = host;
+            listener.port = config.port;
+            listener.fd = -1;
+            listener.options = config.listen_options;
+            listener.defer_seconds = config.client_header_timeout;
+            _listeners.push_back(listener);
         }
+        _listeners[id].vhosts.add(&config);
+    }
+    for (size_t id = 0; id < _listeners.size(); ++id) {
+        _listeners[id].fd = setup_server(_listeners[id]);
+        _listener_by_fd[_listeners[id].fd] = id;
     }
 }
 
-bool Server::is_listener(int fd) {
-    
-    for (size_t i = 0; i < _listen_fds.size(); ++i) {
-        if (_listen_fds[i] == fd)
-            return true;
+static void set_int_option(int fd, int level, int name, int value, const char *label) {
+    if (setsockopt(fd, level, name, &value, sizeof(value)) < 0) {
+        std::cerr << "Warning: could not set " << label << " on listener FD " << fd << std::endl;
     }
-    return false;
 }
 
-void Server::setup_server(int port) {
-    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_fd < 0) throw std::runtime_error("Socket creation failed");
+int Server::setup_server(const Listener &listener) {
+    const std::string &host = listener.host;
+    const ListenOptions &options = listener.options;
+    bool ipv6 = is_ipv6_host(host);
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = ipv6 ? AF_INET6 : AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    std::stringstream port_str;
+    port_str << listener.port;
+    const char *node = (!ipv6 && is_wildcard_host(host)) ? NULL : host.c_str();
+    if (getaddrinfo(node, port_str.str().c_str(), &hints, &res) != 0 || !res) {
+        throw std::runtime_error("Could not resolve listen address " + host);
+    }
+
+    int listen_fd = socket(res->ai_family, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        freeaddrinfo(res);
+        throw std::runtime_error("Socket creation failed");
+    }
 
     // 1. Allow immediate reuse of the port
     int opt = 1;
     setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+#ifdef SO_REUSEPORT
+    // Workers each bind their own socket and the kernel balances between them
+    if (_reuse_port) {
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+    }
+#endif
+    if (ipv6) {
+        // Leaves the IPv4 wildcard of the same port to its own listener
+        setsockopt(listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &opt, sizeof(opt));
+    }
+    // Buffer sizes must be set before listen() to affect window scaling;
+    // accepted sockets inherit them
+    if (options.rcvbuf > 0) {
+        set_int_option(listen_fd, SOL_SOCKET, SO_RCVBUF, options.rcvbuf, "SO_RCVBUF");
+    }
+    if (options.sndbuf > 0) {
+        set_int_option(listen_fd, SOL_SOCKET, SO_SNDBUF, options.sndbuf, "SO_SNDBUF");
+    }
 
-    // 2. Set to non-blocking
+    // 2. Set to non-blocking, and keep it out of CGI children
     fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+    fcntl(listen_fd, F_SETFD, FD_CLOEXEC);
 
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(port);
-
-    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    // Track the fd right away so cleanup() closes it if bind fails
+    _listen_fds.push_back(listen_fd);
+    int bound = bind(listen_fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (bound < 0)
         throw std::runtime_error("Bind failed");
 
-    if (listen(listen_fd, 128) < 0)
+    if (listen(listen_fd, options.backlog) < 0)
         throw std::runtime_error("Listen failed");
 
-    // Add to our poll list
-    pollfd pfd = {listen_fd, POLLIN, 0};
-    _poll_fds.push_back(pfd);
-    _listen_fds.push_back(listen_fd);
-    _listener_ports[listen_fd] = port;
-    
-    std::cout << "Server listening on port " << port << std::endl;
+#ifdef TCP_DEFER_ACCEPT
+    if (options.deferred) {
+        set_int_option(listen_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, static_cast<int>(listener.defer_seconds),
+                       "TCP_DEFER_ACCEPT");
+    }
+#endif
+#ifdef TCP_FASTOPEN
+    if (options.fastopen > 0) {
+        set_int_option(listen_fd, IPPROTO_TCP, TCP_FASTOPEN, options.fastopen, "TCP_FASTOPEN");
+    }
+#endif
+
+    _watch(listen_fd, FD_ROLE_LISTENER, EVENT_READ);
+
+    std::cout << "Server listening on " << (host.empty() ? "*" : (ipv6 ? "[" + host + "]" : host))
+              << ":" << listener.port << " (backlog " << options.backlog << ")" << std::endl;
+    return listen_fd;
 }
 
+// Accepts the whole burst the kernel has queued, up to kAcceptBatch per
+// wakeup, so the backlog drains before it can overflow
 void Server::accept_new_connection(int listen_fd) {
-    struct sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
-    
-    int client_fd = accept(listen_fd, (struct sockaddr*)&client_addr, &addr_len);
-    if (client_fd < 0) return;
+    size_t listener_id = _listener_by_fd[listen_fd];
+    bool nodelay = _listeners[listener_id].options.nodelay;
+    for (size_t accepted = 0; accepted < kAcceptBatch; ++accepted) {
+#ifdef __linux__
+        int client_fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        int client_fd = accept(listen_fd, NULL, NULL);
+        if (client_fd >= 0) {
+            // VERY IMPORTANT: New client must also be non-blocking
+            fcntl(client_fd, F_SETFL, O_NONBLOCK);
+            fcntl(client_fd, F_SETFD, FD_CLOEXEC);
+        }
+#endif
+        if (client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno == EMFILE || errno == ENFILE) {
+                std::cerr << "Out of file descriptors, accept deferred" << std::endl;
+            }
+            return; // EAGAIN: the queue is empty
+        }
+        if (nodelay) {
+            int opt = 1;
+            setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        }
 
-    // VERY IMPORTANT: New client must also be non-blocking
-    fcntl(client_fd, F_SETFL, O_NONBLOCK);
+        // Create our state-tracking object
+        Client *c = _clients.acquire(client_fd, static_cast<int>(listener_id), _listeners[listener_id].port);
+        c->config = &select_config(c->request, *c);
+        refresh_timer(*c);
 
-    // Create our state-tracking object
-    int listen_port = _listener_ports.count(listen_fd) ? _listener_ports[listen_fd] : 0;
-    _clients[client_fd] = new Client(client_fd, listen_port);
+        // Only ask for writability once there is a response to send
+        _watch(client_fd, FD_ROLE_CLIENT, EVENT_READ);
 
-    // Add to poll list
-    pollfd pfd = {client_fd, static_cast<short>(POLLIN | POLLOUT), 0};
-    _poll_fds.push_back(pfd);
-    
-    std::cout << "New client connected on FD " << client_fd << std::endl;
+        std::cout << "New client connected on FD " << client_fd << std::endl;
+    }
 }
 
+// recv() fills the shared _recv_buffer, in a window that adapts to how full
+// the previous reads were, and only the bytes received are appended to
+// request_buffer. The socket is drained until EAGAIN, a short read or
+// kReadBudget bytes, so one busy upload cannot starve the others.
 void Server::handle_client_read(int fd, Client &c) {
-    if (c.state != STATE_READING_REQUEST) {
-        return;
-    }
-    char buffer[4096];
-    int bytes_read = recv(fd, buffer, sizeof(buffer) - 1, 0);
+    size_t budget = kReadBudget;
+    while (c.state == STATE_READING_REQUEST && budget > 0) {
+        size_t window = std::min(c.recv_window, _recv_buffer.size());
+        ssize_t bytes_read = recv(fd, &_recv_buffer[0], window, 0);
+        if (bytes_read > 0) {
+            c.request_buffer.append(&_recv_buffer[0], bytes_read);
+        }
 
-    if (bytes_read <= 0) {
-        if (bytes_read == 0) {
-            std::cout << "Client FD " << fd << " disconnected." << std::endl;
-        } else {
-            std::cerr << "Recv error on FD " << fd << std::endl;
+        if (bytes_read <= 0) {
+            if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return; // Drained, or a spurious wakeup
+            }
+            if (bytes_read == 0) {
+                std::cout << "Client FD " << fd << " disconnected." << std::endl;
+            } else {
+                std::cerr << "Recv error on FD " << fd << std::endl;
+            }
+            c.state = STATE_DONE; // Signal to clean up this client
+            return;
         }
-        c.state = STATE_DONE; // Signal to clean up this client
-        return;
-    }
+        c.record_read(bytes_read, _global.client_receive_buffer_max);
+        budget -= std::min(budget, static_cast<size_t>(bytes_read));
 
-    buffer[bytes_read] = '\0';
-    c.request_buffer.append(buffer, bytes_read);
-    c.last_activity = time(NULL); // Reset timeout timer
+        // Parsing between reads keeps spooled uploads flushing as they arrive
+        parse_request(c);
+        if (static_cast<size_t>(bytes_read) < window) {
+            return; // Short read: the socket is empty
+        }
+    }
+}
 
+// Advances the request state machine over whatever is already buffered.
+// Also used to pick up pipelined requests left over after a response.
+void Server::parse_request(Client &c) {
     if (c.state != STATE_READING_REQUEST || c.request_complete) {
         return;
     }
 
     if (!c.header_parsed) {
-        size_t header_end = c.request_buffer.find("\r\n\r\n");
+        // Resume the search where the previous read stopped
+        size_t from = c.header_scan_pos > 3 ? c.header_scan_pos - 3 : 0;
+        size_t header_end = c.request_buffer.find("\r\n\r\n", from);
+        size_t header_size = header_end == std::string::npos ? c.request_buffer.size() : header_end + 4;
+        if (header_size > _global.client_max_header_size) {
+            Request none;
+            Response res(431, "Request Header Fields Too Large", *c.config, select_route(none, *c.config));
+            c.close_after_write = true; // The rest of the header is never read
+            queue_response(c, res);
+            return;
+        }
         if (header_end == std::string::npos) {
+            c.header_scan_pos = c.request_buffer.size();
             return;
         }
         c.header_parsed = true;
         c.header_end = header_end + 4;
-        c.chunk_parse_pos = c.header_end;
+        c.cgi_response.reset(false, false, false); // Nothing left from an earlier script
+
+        // The one and only header parse for this request
+        bool valid = c.request.parse(c.request_buffer, c.header_end);
+        const ServerConfig &config = select_config(c.request, c);
+        const RouteConfig &route = select_route(c.request, config);
+        c.config = &config;
         if (!c.config_resolved) {
-            Request req(c.request_buffer);
-            const ServerConfig &config = select_config(req, c);
-            RouteConfig route = select_route(req, config);
             c.max_body_size = route.max_body_size_set ? route.max_body_size : config.max_body_size;
             c.config_resolved = true;
         }
 
-        std::string header_part = c.request_buffer.substr(0, header_end);
-        std::stringstream ss(header_part);
-        std::string line;
-        while (std::getline(ss, line)) {
-            if (!line.empty() && line[line.size() - 1] == '\r') {
-                line.erase(line.size() - 1);
-            }
-            size_t colon_pos = line.find(':');
-            if (colon_pos == std::string::npos) {
-                continue;
-            }
-            std::string key = line.substr(0, colon_pos);
-            std::string value = line.substr(colon_pos + 1);
-            size_t first = value.find_first_not_of(' ');
-            if (first != std::string::npos) {
-                value = value.substr(first);
-            }
-            if (key == "Content-Length") {
-                c.content_length = static_cast<size_t>(std::strtoul(value.c_str(), NULL, 10));
-            }
-            if (key == "Transfer-Encoding" && value.find("chunked") != std::string::npos) {
-                c.chunked = true;
-            }
+        c.chunked = c.request.header_has_token("Transfer-Encoding", "chunked");
+        if (valid && !c.chunked && c.request.has_header("Content-Length")) {
+            std::string value = c.request.get_header("Content-Length");
+            char *end = NULL;
+            c.content_length = static_cast<size_t>(std::strtoul(value.c_str(), &end, 10));
+            valid = !value.empty() && *end == '\0' && value[0] != '-';
+        }
+        if (!valid) {
+            Response res(400, "Bad Request", config, route);
+            c.close_after_write = true; // Cannot tell where the next request starts
+            queue_response(c, res);
+            return;
         }
         if (c.max_body_size > 0 && c.content_length > c.max_body_size) {
-            Request req(c.request_buffer);
-            const ServerConfig &config = select_config(req, c);
-            RouteConfig route = select_route(req, config);
             Response res(413, "Payload Too Large", config, route);
-            c.response_buffer = res.get_raw_response();
-            c.state = STATE_WRITING_RESPONSE;
-            update_poll_events(c.fd, POLLIN | POLLOUT);
+            c.close_after_write = true; // The body was never read
+            queue_response(c, res);
+            return;
+        }
+        c.body_buffer_size = config.client_body_buffer_size;
+        // Uploads are spooled to disk as they arrive instead of being buffered,
+        // and so are CGI bodies too big for client_body_buffer_size
+        std::string spool_dir;
+        if ((c.chunked || c.content_length > 0) && is_upload_request(c.request, route, config)) {
+            spool_dir = route.upload_dir;
+        } else if ((c.chunked || c.content_length > c.body_buffer_size)
+                && is_method_allowed(c.request.get_method(), route)
+                && is_cgi_request(c.request.get_path(), route, config)) {
+            spool_dir = route.upload_dir.empty() ? kCgiSpoolDir : route.upload_dir;
+        }
+        if (!spool_dir.empty() && !open_body_sink(c, spool_dir)) {
+            Response res(500, "Internal Server Error", config, route);
+            c.close_after_write = true;
+            queue_response(c, res);
             return;
         }
     }
 
     if (c.chunked) {
-        while (true) {
-            size_t line_end = c.request_buffer.find("\r\n", c.chunk_parse_pos);
-            if (line_end == std::string::npos) {
-                return;
-            }
-            std::string size_str = c.request_buffer.substr(c.chunk_parse_pos, line_end - c.chunk_parse_pos);
-            size_t semicolon = size_str.find(';');
-            if (semicolon != std::string::npos) {
-                size_str = size_str.substr(0, semicolon);
-            }
-            size_t chunk_size = static_cast<size_t>(std::strtoul(size_str.c_str(), NULL, 16));
-            size_t data_start = line_end + 2;
-            size_t data_end = data_start + chunk_size;
-            if (c.request_buffer.size() < data_end + 2) {
+        // The decoder hands payload to the client as it goes; only the framing
+        // bytes it consumed are dropped, so request_buffer stays small
+        size_t consumed = 0;
+        ChunkedDecoder::e_result result = c.chunk_decoder.feed(c.request_buffer.data() + c.header_end,
+            c.request_buffer.size() - c.header_end, consumed, c);
+        c.request_buffer.erase(c.header_end, consumed);
+        if (result == ChunkedDecoder::CHUNKED_NEED_MORE) {
+            return;
+        }
+        if (result == ChunkedDecoder::CHUNKED_ERROR) {
+            if (c.body_write_failed) {
+                std::cerr << "Upload write failed for FD " << c.fd << std::endl;
+                fail_body_sink(c);
                 return;
             }
-            if (chunk_size == 0) {
-                std::string header_part = c.request_buffer.substr(0, c.header_end);
-                c.request_buffer = header_part + c.decoded_body;
-                c.request_complete = true;
-                c.state = STATE_PROCESSING;
+            const ServerConfig &config = select_config(c.request, c);
+            const RouteConfig &route = select_route(c.request, config);
+            bool too_large = c.max_body_size > 0 && c.body_received > c.max_body_size;
+            Response res(too_large ? 413 : 400, too_large ? "Payload Too Large" : "Bad Request", config, route);
+            c.discard_body_sink();
+            c.close_after_write = true;
+            queue_response(c, res);
+            return;
+        }
+        if (c.body_sink_fd != -1) {
+            if (!c.write_body_sink(c.decoded_body.data(), c.decoded_body.size())) {
+                std::cerr << "Upload write failed for FD " << c.fd << std::endl;
+                fail_body_sink(c);
                 return;
             }
-            c.decoded_body.append(c.request_buffer.substr(data_start, chunk_size));
-            if (c.max_body_size > 0 && c.decoded_body.size() > c.max_body_size) {
-                Request req(c.request_buffer);
-                const ServerConfig &config = select_config(req, c);
-                RouteConfig route = select_route(req, config);
-                Response res(413, "Payload Too Large", config, route);
-                c.response_buffer = res.get_raw_response();
-                c.state = STATE_WRITING_RESPONSE;
-                update_poll_events(c.fd, POLLIN | POLLOUT);
+            c.decoded_body.clear();
+        }
+        // Whatever follows the last chunk is the next pipelined request
+        c.request_buffer.insert(c.header_end, c.decoded_body);
+        c.request_end = c.header_end + c.decoded_body.size();
+        c.request.set_body(c.header_end, c.decoded_body.size());
+        c.decoded_body.clear();
+        c.request_complete = true;
+        c.state = STATE_PROCESSING;
+    } else if (c.content_length > 0 && c.body_sink_fd != -1) {
+        // Flush once client_body_buffer_size is buffered or the body is complete,
+        // so at most that much of the upload is ever held in memory
+        size_t available = c.request_buffer.size() - c.header_end;
+        size_t take = std::min(available, c.content_length - c.body_received);
+        if (take >= c.body_buffer_size || c.body_received + take == c.content_length) {
+            if (!c.write_body_sink(c.request_buffer.data() + c.header_end, take)) {
+                std::cerr << "Upload write failed for FD " << c.fd << std::endl;
+                fail_body_sink(c);
                 return;
             }
-            c.chunk_parse_pos = data_end + 2;
+            c.request_buffer.erase(c.header_end, take);
+            c.body_received += take;
+        }
+        if (c.body_received == c.content_length) {
+            c.request_end = c.header_end;
+            c.request.set_body(c.header_end, 0);
+            c.request_complete = true;
+            c.state = STATE_PROCESSING;
         }
     } else if (c.content_length > 0) {
         if (c.request_buffer.size() >= c.header_end + c.content_length) {
+            c.request_end = c.header_end + c.content_length;
+            c.request.set_body(c.header_end, c.content_length);
             c.request_complete = true;
             c.state = STATE_PROCESSING;
         }
     } else if (c.header_parsed) {
+        c.request_end = c.header_end;
         c.request_complete = true;
         c.state = STATE_PROCESSING;
     }
 }
 
-void Server::handle_client_write(int fd, Client &c) {
-    if (c.response_buffer.empty()) return;
-
-    // send() returns the number of bytes actually accepted by the kernel
-    ssize_t bytes_sent = send(fd, c.response_buffer.c_str(), c.response_buffer.size(), 0);
+bool Server::is_upload_request(const Request &req, const RouteConfig &route, const ServerConfig &config) const {
+    return req.get_method() == "POST" && !route.upload_dir.empty()
+        && is_method_allowed(req.get_method(), route)
+        && !is_cgi_request(req.get_path(), route, config);
+}
 
-    if (bytes_sent > 0) {
-        // Remove the bytes that were successfully sent from the buffer
-        c.response_buffer.erase(0, bytes_sent);
-        c.last_activity = time(NULL);
+bool Server::open_body_sink(Client &c, const std::string &upload_dir) {
+    std::stringstream path;
+    path << upload_dir;
+    if (upload_dir[upload_dir.size() - 1] != '/') {
+        path << "/";
+    }
+    path << ".upload_" << getpid() << "_" << ++_upload_seq << ".part";
+    // Readable too: a spooled CGI body is fed back out of it
+    c.body_sink_fd = open(path.str().c_str(), O_RDWR | O_CREAT | O_EXCL | O_TRUNC | O_CLOEXEC, 0644);
+    if (c.body_sink_fd < 0) {
+        std::cerr << "Could not create upload file " << path.str() << std::endl;
+        return false;
+    }
+    c.body_sink_path = path.str();
+    return true;
+}
 
-        // If the buffer is now empty, we are finished with this response
-        if (c.response_buffer.empty()) {
-            std::cout << "Response fully sent to FD " << fd << std::endl;
-            c.state = STATE_DONE; 
+// Makes the upload durable, then gives it its final name. The name is
+// unique per worker (pid) and upload (_upload_seq), and link() refuses to
+// replace an existing file, so no earlier upload is ever overwritten.
+bool Server::commit_body_sink(Client &c, const std::string &upload_dir) {
+    if (fsync(c.body_sink_fd) < 0 || close(c.body_sink_fd) < 0) {
+        c.body_sink_fd = -1;
+        return false;
+    }
+    c.body_sink_fd = -1;
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        std::stringstream path;
+        path << upload_dir;
+        if (upload_dir[upload_dir.size() - 1] != '/') {
+            path << "/";
+        }
+        path << "upload_" << time(NULL) << "_" << getpid() << "_" << ++_upload_seq << ".bin";
+        if (link(c.body_sink_path.c_str(), path.str().c_str()) == 0) {
+            unlink(c.body_sink_path.c_str());
+            c.body_sink_path.clear();
+            return true;
+        }
+        if (errno != EEXIST) {
+            break;
         }
-    } else if (bytes_sent == -1) {
+    }
+    return false;
+}
+
+void Server::fail_body_sink(Client &c) {
+    const ServerConfig &config = select_config(c.request, c);
+    const RouteConfig &route = select_route(c.request, config);
+    Response res(500, "Internal Server Error", config, route);
+    c.discard_body_sink();
+    c.close_after_write = true;
+    queue_response(c, res);
+}
+
+void Server::handle_client_write(int fd, Client &c) {
+    OutputQueue::e_send_result result = c.output.send_to(fd);
+    if (result == OutputQueue::SEND_ERROR) {
         std::cerr << "Send error on FD " << fd << std::endl;
         c.state = STATE_ERROR;
+        return;
+    }
+    if (c.cgi_paused && c.output.memory_bytes() < kCgiHighWater / 2) {
+        set_cgi_paused(c, false);
+    }
+    if (c.gzip_fd != -1 && c.output.memory_bytes() < kGzipHighWater / 2) {
+        pump_gzip_body(c);
+        if (!c.output.empty()) {
+            return;
+        }
+    }
+    if (result == OutputQueue::SEND_DONE && c.state == STATE_WAITING_FOR_CGI) {
+        update_events(fd, 0); // Caught up with the script
+    } else if (result == OutputQueue::SEND_DONE) {
+        std::cout << "Response fully sent to FD " << fd << std::endl;
+        finish_response(c);
+    }
+}
+
+// Either closes the connection or goes back to reading the next request
+void Server::finish_response(Client &c) {
+    if (c.close_after_write) {
+        c.state = STATE_DONE;
+        return;
+    }
+    c.state = STATE_READING_REQUEST;
+    update_events(c.fd, EVENT_READ);
+    // Pipelined bytes may already hold (part of) the next request
+    if (!c.request_buffer.empty()) {
+        parse_request(c);
+    }
+}
+
+// Queues head, Connection line and body as separate segments: nothing is
+// concatenated, and file bodies go out with sendfile() after the head
+void Server::queue_response(Client &c, Response &res) {
+    std::string head = res.get_head();
+    std::string body;
+    res.take_body(body);
+    c.output.append_owned(head);
+    c.output.append_static(res.get_connection_header());
+    c.output.append_owned(body);
+    if (res.has_file_body()) {
+        queue_file_body(c, res);
+    }
+    c.state = STATE_WRITING_RESPONSE;
+    update_events(c.fd, EVENT_WRITE);
+}
+
+// The whole file, or each 206 part at its offset. Segments own their fd,
+// so every part but the last sends from a duplicate.
+void Server::queue_file_body(Client &c, Response &res) {
+    const std::vector<Response::ByteRange> &ranges = res.get_ranges();
+    int fd = res.release_file_fd();
+    if (ranges.empty()) {
+        c.output.append_file(fd, 0, res.get_file_size());
+        return;
+    }
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        int part_fd = (i + 1 == ranges.size()) ? fd : fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (part_fd == -1) {
+            // Out of descriptors: the response is cut short, so end the connection with it
+            std::cerr << "dup() for a range part failed: " << strerror(errno) << std::endl;
+            close(fd);
+            c.close_after_write = true;
+            return;
+        }
+        std::string head = ranges[i].head;
+        c.output.append_owned(head);
+        c.output.append_file(part_fd, ranges[i].start, ranges[i].length);
+    }
+    std::string tail = res.get_ranges_tail();
+    c.output.append_owned(tail);
+}
+
+// Compressible files the static cache does not keep: deflated a slice at
+// a time as the socket drains, each slice sent as one chunk
+void Server::queue_gzip_body(Client &c, Response &res) {
+    if (!c.gzip.begin(Response::kGzipLevel)) {
+        queue_response(c, res); // Identity body
+        return;
+    }
+    res.chunk_gzip_body();
+    std::string head = res.get_head();
+    c.output.append_owned(head);
+    c.output.append_static(res.get_connection_header());
+    c.gzip_size = res.get_file_size();
+    c.gzip_offset = 0;
+    c.gzip_fd = res.release_file_fd();
+    c.state = STATE_WRITING_RESPONSE;
+    update_events(c.fd, EVENT_WRITE);
+    pump_gzip_body(c);
+}
+
+// Queues chunks until kGzipHighWater bytes wait in memory; the last one
+// carries the gzip trailer and is followed by the terminating chunk. A
+// read or deflate error leaves the body unterminated and the connection
+// closes after it, which is how the client learns it was cut short.
+void Server::pump_gzip_body(Client &c) {
+    char slice[kGzipSlice];
+    std::string compressed;
+    while (c.gzip_fd != -1 && c.output.memory_bytes() < kGzipHighWater) {
+        compressed.clear();
+        if (c.gzip_offset < c.gzip_size) {
+            size_t want = static_cast<size_t>(std::min(static_cast<off_t>(sizeof(slice)), c.gzip_size - c.gzip_offset));
+            ssize_t bytes = pread(c.gzip_fd, slice, want, c.gzip_offset);
+            if (bytes <= 0 || !c.gzip.update(slice, static_cast<size_t>(bytes), compressed)) {
+                c.close_gzip_body();
+                c.close_after_write = true;
+                return;
+            }
+            c.gzip_offset += bytes;
+        }
+        bool last = c.gzip_offset >= c.gzip_size;
+        if (last && !c.gzip.finish(compressed)) {
+            c.close_gzip_body();
+            c.close_after_write = true;
+            return;
+        }
+        if (!compressed.empty()) {
+            std::stringstream size;
+            size << std::hex << compressed.size() << "\r\n";
+            std::string size_line = size.str();
+            compressed += "\r\n";
+            c.output.append_owned(size_line);
+            c.output.append_owned(compressed);
+        }
+        if (last) {
+            c.output.append_static("0\r\n\r\n");
+            c.close_gzip_body();
+        }
+    }
+}
+
+void Server::queue_response(Client &c, std::string &raw) {
+    // Queued after any earlier pipelined response, drained in one sendmsg()
+    c.output.append_owned(raw);
+    c.state = STATE_WRITING_RESPONSE;
+    update_events(c.fd, EVENT_WRITE);
+}
+
+bool Server::wants_keep_alive(const Request &req, const Client &c, const ServerConfig &config) const {
+    if (config.keepalive_timeout <= 0 || config.keepalive_requests == 0) {
+        return false;
+    }
+    if (c.requests_served + 1 >= config.keepalive_requests) {
+        return false;
+    }
+    // HTTP/1.1 is persistent unless told otherwise, HTTP/1.0 only on request
+    if (req.get_version() == "HTTP/1.1") {
+        return !req.header_has_token("Connection", "close");
     }
+    return req.header_has_token("Connection", "keep-alive");
+}
+
+namespace {
+// Drops the finished request from the client buffer when process_request
+// returns, after every user of the parsed offsets is done with them
+struct RequestConsumer {
+    Client &client;
+    bool    active;
+    explicit RequestConsumer(Client &c) : client(c), active(true) {}
+    ~RequestConsumer() { if (active) client.begin_next_request(); }
+    // The request stays parsed so it can be replayed later
+    void keep() { active = false; }
+};
 }
 
 void Server::process_request(Client &c) {
-    Request req(c.request_buffer);
+    RequestConsumer consume(c);
+    const Request &req = c.request;
     const ServerConfig &config = select_config(req, c);
-    RouteConfig route = select_route(req, config);
+    const RouteConfig &route = select_route(req, config);
+
+    bool keep_alive = wants_keep_alive(req, c, config);
+    if (!keep_alive) {
+        c.close_after_write = true;
+    }
+    ++c.requests_served;
 
     if (!is_method_allowed(req.get_method(), route)) {
-        Response res(405, "Method Not Allowed", config, route);
-        c.response_buffer = res.get_raw_response();
-        c.state = STATE_WRITING_RESPONSE;
-        update_poll_events(c.fd, POLLIN | POLLOUT);
+        Response res(405, "Method Not Allowed", config, route, keep_alive);
+        queue_response(c, res);
         return;
     }
 
-    // CGI Handling
-    if (is_cgi_request(req.get_path(), route, config)) {
-        std::string root = route.root.empty() ? config.root : route.root;
-        CgiHandler cgi(req, root + req.get_path());
-        int pipe_fd = cgi.launch();
-
-        if (pipe_fd != -1) {
-            c.cgi_pipe_fd = pipe_fd;
-            c.cgi_pid = cgi.get_pid();
+    // Micro-cache: GETs without a body, served from memory or collapsed
+    // onto the one script already producing the response
+    std::string cgi_key;
+    if (route.cgi_cache_ttl > 0 && _cgi_cache.enabled() && req.get_method() == "GET"
+            && req.body_size() == 0 && c.body_sink_fd == -1 && is_cgi_request(req.get_path(), route, config)) {
+        cgi_key = cgi_cache_key(req, config, route);
+        const CgiCache::Entry *hit = _cgi_cache.lookup(cgi_key, _now);
+        if (hit) {
+            queue_cached_response(c, hit->response, hit->head_size, keep_alive);
+            return;
+        }
+        if (_cgi_cache.filling(cgi_key)) {
+            consume.keep();
+            --c.requests_served; // Counted again when replayed
+            _cgi_cache.wait(cgi_key, c.fd);
+            c.cache_role = CACHE_WAITING;
+            c.cache_key = cgi_key;
             c.state = STATE_WAITING_FOR_CGI;
+            update_events(c.fd, c.output.empty() ? 0 : EVENT_WRITE);
+            return;
+        }
+        if (_cgi_cache.is_passed(cgi_key, _now)) {
+            cgi_key.clear();
+        }
+    }
 
-            _cgi_fds[pipe_fd] = &c;
-            pollfd pfd = {pipe_fd, POLLIN, 0};
-            _poll_fds.push_back(pfd);
-            return; 
+    // CGI Handling
+    if (is_cgi_request(req.get_path(), route, config)) {
+        if (!route.fastcgi_pass.empty()) {
+            start_fastcgi(c, config, route, keep_alive);
+        } else {
+            e_admission admission = _cgi_queue.admit(route, c.fd, _now);
+            if (admission == ADMISSION_REJECTED) {
+                queue_busy_response(c);
+                return;
+            }
+            if (admission == ADMISSION_QUEUED) {
+                consume.keep();
+                --c.requests_served; // Counted again when replayed
+                c.cgi_queue = &route;
+                c.state = STATE_WAITING_FOR_CGI;
+                update_events(c.fd, c.output.empty() ? 0 : EVENT_WRITE);
+                return;
+            }
+            start_cgi(c, config, route, keep_alive);
+        }
+        if (!cgi_key.empty() && c.state == STATE_WAITING_FOR_CGI) {
+            _cgi_cache.begin_fill(cgi_key);
+            c.cache_role = CACHE_FILLING;
+            c.cache_key = cgi_key;
+            c.cache_ttl = route.cgi_cache_ttl;
+            c.cgi_response.capture(_cgi_cache.max_entry_size());
         }
+        return;
     }
 
     if (req.get_method() == "POST") {
         std::string upload_dir = route.upload_dir.empty() ? config.upload_dir : route.upload_dir;
         if (upload_dir.empty()) {
-            Response res(403, "Forbidden", config, route);
-            c.response_buffer = res.get_raw_response();
-            c.state = STATE_WRITING_RESPONSE;
-            update_poll_events(c.fd, POLLIN | POLLOUT);
+            Response res(403, "Forbidden", config, route, keep_alive);
+            queue_response(c, res);
             return;
         }
-        std::stringstream path;
-        path << upload_dir;
-        if (upload_dir[upload_dir.size() - 1] != '/') {
-            path << "/";
-        }
-        path << "upload_" << c.fd << "_" << time(NULL) << ".bin";
-        std::ofstream out(path.str().c_str(), std::ios::binary);
-        if (!out.is_open()) {
-            Response res(500, "Internal Server Error", config, route);
-            c.response_buffer = res.get_raw_response();
-            c.state = STATE_WRITING_RESPONSE;
-            update_poll_events(c.fd, POLLIN | POLLOUT);
+        // Body-less uploads never opened a sink while reading
+        if ((c.body_sink_fd == -1 && !open_body_sink(c, upload_dir))
+                || !c.write_body_sink(req.body_data(), req.body_size())
+                || !commit_body_sink(c, upload_dir)) {
+            c.discard_body_sink();
+            Response res(500, "Internal Server Error", config, route, keep_alive);
+            queue_response(c, res);
             return;
         }
-        out.write(req.get_body().c_str(), req.get_body().size());
-        out.close();
         std::stringstream res;
         res << "HTTP/1.1 201 Created\r\n";
         res << "Content-Type: text/plain\r\n";
         res << "Content-Length: 0\r\n";
-        res << "Connection: close\r\n\r\n";
-        c.response_buffer = res.str();
-        c.state = STATE_WRITING_RESPONSE;
-        update_poll_events(c.fd, POLLIN | POLLOUT);
+        res << (keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+        std::string raw = res.str();
+        queue_response(c, raw);
         return;
     }
 
     // Static Handling
-    Response res(req, config, route);
-    c.response_buffer = res.get_raw_response();
+    std::string cache_key;
+    if (_static_cache.enabled() && route.redirect_code == 0) {
+        cache_key = static_cache_key(req, config, route);
+        if (req.get_method() == "DELETE") {
+            // Every Accept-Encoding variant of the path
+            static const char *variants[] = { "", "gzip", "br", "br,gzip", "gzip,br" };
+            std::string base = cache_key.substr(0, cache_key.rfind('\n') + 1);
+            for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); ++i) {
+                _static_cache.invalidate(base + variants[i]);
+            }
+            cache_key.clear();
+        } else if (req.get_method() == "GET" && req.has_header("Range")) {
+            cache_key.clear(); // Parts are cut from the file, never the cache
+        } else if (req.get_method() == "GET") {
+            const StaticCache::Entry *hit = _static_cache.lookup(cache_key);
+            if (hit && Response::not_modified(req, hit->etag, hit->mtime)) {
+                std::string raw = "HTTP/1.1 304 Not Modified\r\n" + hit->validators;
+                raw += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+                queue_response(c, raw);
+                return;
+            }
+            if (hit) {
+                queue_cached_response(c, hit->response, hit->head_size, keep_alive);
+                return;
+            }
+        }
+    }
+    Response res(req, config, route, keep_alive);
+    if (!cache_key.empty() && res.has_file_body() && _static_cache.fits(res.get_file_size())) {
+        // Compressed once here, then served from the cache
+        if (res.wants_gzip()) {
+            res.gzip_file_body();
+        }
+        std::string body;
+        const StaticCache::Entry *entry = NULL;
+        if (res.read_body(body)) {
+            entry = _static_cache.store(cache_key, res.get_head(), body, res.get_file_path(), res.get_file_stat(),
+                                        res.get_sidecar_path(), res.get_sidecar_stat(), res.get_skipped_sidecars(),
+                                        res.get_etag(), res.get_validators());
+        }
+        if (entry) {
+            // Already in memory, so skip sendfile; res closes the fd
+            queue_cached_response(c, entry->response, entry->head_size, keep_alive);
+            return;
+        }
+    }
+    // Everything else pays for deflate on each request. HTTP/1.0 has no
+    // chunked framing, so it gets the identity body.
+    if (res.wants_gzip() && req.get_version() == "HTTP/1.1") {
+        queue_gzip_body(c, res);
+        return;
+    }
+    queue_response(c, res);
+}
+
+void Server::start_cgi(Client &c, const ServerConfig &config, const RouteConfig &route, bool keep_alive) {
+    const Request &req = c.request;
+    std::string root = route.root.empty() ? config.root : route.root;
+    CgiHandler cgi(req, root + req.get_path(), cgi_interpreter(req.get_path(), route, config));
+    // Chunked bodies carry no header: announce what start_cgi_input will feed
+    std::stringstream length;
+    length << (c.body_sink_fd != -1 ? c.body_received : req.body_size());
+    cgi.set_env("CONTENT_LENGTH", length.str());
+    int pipe_fd = cgi.launch();
+
+    if (pipe_fd == -1) {
+        Response res(500, "Internal Server Error", config, route, keep_alive);
+        queue_response(c, res);
+        _cgi_queue.release(&route);
+        admit_cgi_waiters(&route);
+        return;
+    }
+    c.cgi_pipe_fd = pipe_fd;
+    c.cgi_pid = cgi.get_pid();
+    c.cgi_output_bytes = 0;
+    track_child(c.cgi_pid, c.fd, route);
+    c.state = STATE_WAITING_FOR_CGI;
+    c.cgi_response.reset(keep_alive, req.get_version() == "HTTP/1.1", req.get_method() == "HEAD");
+    // Earlier pipelined responses may still be draining
+    update_events(c.fd, c.output.empty() ? 0 : EVENT_WRITE);
+
+    _clients.attach(pipe_fd, &c);
+    _watch(pipe_fd, FD_ROLE_CGI, EVENT_READ);
+    start_cgi_input(c, cgi.get_stdin_fd());
+}
+
+// Same filesystem mapping as Response: root + path, per vhost
+std::string Server::static_cache_key(const Request &req, const ServerConfig &config, const RouteConfig &route) const {
+    std::string root = route.root.empty() ? config.root : route.root;
+    std::stringstream key;
+    key << config.server_name << ':' << config.port << '\n' << root;
+    key << (req.get_path().empty() ? "/" : req.get_path());
+    // One entry per set of codings the client takes, so each compressed
+    // variant is stored (and compressed) once
+    key << '\n' << Response::accepted_encodings(req, config);
+    return key.str();
+}
+
+// Method, vhost, path with query, then the location's chosen headers
+std::string Server::cgi_cache_key(const Request &req, const ServerConfig &config, const RouteConfig &route) const {
+    std::stringstream key;
+    key << req.get_method() << '\n' << config.server_name << ':' << config.port << '\n' << req.get_path();
+    for (size_t i = 0; i < route.cgi_cache_key_headers.size(); ++i) {
+        key << '\n' << route.cgi_cache_key_headers[i] << ':' << req.get_header(route.cgi_cache_key_headers[i].c_str());
+    }
+    return key.str();
+}
+
+// Called once the filling script is done ('finished') or its client gone.
+// Waiters replay their request: they hit the new entry, or run their own
+// script when the response could not be cached.
+void Server::end_cache_fill(Client &c, bool finished) {
+    if (c.cache_role != CACHE_FILLING) {
+        return;
+    }
+    std::string key;
+    key.swap(c.cache_key);
+    c.cache_role = CACHE_NONE;
+    std::string head;
+    std::string body;
+    long max_age = -1;
+    if (finished && c.cgi_response.cacheable(head, body, max_age)) {
+        msec_t ttl = static_cast<msec_t>(max_age >= 0 ? max_age : c.cache_ttl) * 1000;
+        _cgi_cache.store(key, head, body, _now + ttl);
+    } else if (finished) {
+        // Let identical requests run in parallel instead of queueing
+        _cgi_cache.mark_uncacheable(key, _now + static_cast<msec_t>(c.cache_ttl) * 1000);
+    }
+    std::vector<int> waiters;
+    _cgi_cache.end_fill(key, waiters);
+    for (size_t i = 0; i < waiters.size(); ++i) {
+        Client *w = _clients.client_at(waiters[i]);
+        if (w && w->cache_role == CACHE_WAITING && w->cache_key == key) {
+            w->cache_role = CACHE_NONE;
+            w->cache_key.clear();
+            replay_request(*w);
+        }
+    }
+}
+
+void Server::replay_request(Client &c) {
+    c.state = STATE_PROCESSING;
+    while (c.state == STATE_PROCESSING) {
+        process_request(c);
+    }
+    if (c.state == STATE_DONE || c.state == STATE_ERROR) {
+        close_client(c.fd);
+    } else {
+        refresh_timer(c);
+    }
+}
+
+void Server::queue_cached_response(Client &c, SharedBuffer *response, size_t head_size, bool keep_alive) {
+    // The cached bytes are referenced, not copied, and outlive an eviction
+    size_t total = response->data().size();
+    c.output.append_shared(response, 0, head_size);
+    c.output.append_static(keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+    c.output.append_shared(response, head_size, total - head_size);
     c.state = STATE_WRITING_RESPONSE;
-    
-    // Switch from listening for data to waiting for the buffer to clear
-    update_poll_events(c.fd, POLLIN | POLLOUT);
+    update_events(c.fd, EVENT_WRITE);
+}
+
+// Hands the request body to the script's stdin pipe, fed from the loop as
+// the pipe drains: straight from the spool file when the body was spooled,
+// otherwise from a copy that outlives the request buffer.
+void Server::start_cgi_input(Client &c, int stdin_fd) {
+    c.cgi_input_offset = 0;
+    c.cgi_input_fd = take_spooled_body(c);
+    if (c.cgi_input_fd != -1) {
+        c.cgi_input_size = static_cast<off_t>(c.body_received);
+    } else {
+        c.cgi_input.assign(c.request.body_data(), c.request.body_size());
+        c.cgi_input_size = static_cast<off_t>(c.cgi_input.size());
+    }
+    c.cgi_stdin_fd = stdin_fd;
+    if (c.cgi_input_size == 0) {
+        close_cgi_input(c); // Immediate EOF on stdin
+        return;
+    }
+    _clients.attach(stdin_fd, &c);
+    _watch(stdin_fd, FD_ROLE_CGI_INPUT, EVENT_WRITE);
 }
 
-void Server::handle_cgi_read(int pipe_fd, size_t &poll_idx) {
-    Client *c = _cgi_fds[pipe_fd];
-    char buffer[4096];
-    int bytes = read(pipe_fd, buffer, sizeof(buffer) - 1);
+// Detaches the spooled body from the client; the file is unlinked and
+// lives on until the returned fd is closed. -1 when nothing was spooled.
+int Server::take_spooled_body(Client &c) {
+    int fd = c.body_sink_fd;
+    if (fd != -1) {
+        c.body_sink_fd = -1;
+        unlink(c.body_sink_path.c_str());
+        c.body_sink_path.clear();
+    }
+    return fd;
+}
 
-    if (bytes > 0) {
-        buffer[bytes] = '\0';
-        c->response_buffer.append(buffer, bytes);
-        c->last_activity = time(NULL);
+// Same variables as a forked CGI, sent as FCGI_PARAMS; the backend, not
+// the filesystem, decides what SCRIPT_FILENAME means
+void Server::start_fastcgi(Client &c, const ServerConfig &config, const RouteConfig &route, bool keep_alive) {
+    const Request &req = c.request;
+    std::string root = route.root.empty() ? config.root : route.root;
+    CgiHandler cgi(req, root + req.get_path());
+    std::map<std::string, std::string> params = cgi.get_env();
+
+    int body_fd = take_spooled_body(c);
+    off_t body_size = body_fd != -1 ? static_cast<off_t>(c.body_received) : static_cast<off_t>(req.body_size());
+    std::stringstream length;
+    length << body_size;
+    params["CONTENT_LENGTH"] = length.str(); // Chunked bodies carry no header
+
+    std::string body;
+    if (body_fd == -1) {
+        body.assign(req.body_data(), req.body_size());
+    }
+    if (!_fastcgi.start(c, route.fastcgi_pass, route.fastcgi_addr, route.fastcgi_addr_len, params, body_fd,
+                        body_size, body)) {
+        std::cerr << "FastCGI backend " << route.fastcgi_pass << " unavailable" << std::endl;
+        Response res(502, "Bad Gateway", config, route, keep_alive);
+        queue_response(c, res);
+        return;
+    }
+    c.state = STATE_WAITING_FOR_CGI;
+    c.cgi_response.reset(keep_alive, req.get_version() == "HTTP/1.1", req.get_method() == "HEAD");
+    update_events(c.fd, c.output.empty() ? 0 : EVENT_WRITE);
+}
+
+void Server::fastcgi_watch(int fd, int events) {
+    if (_role_of(fd) == FD_ROLE_FASTCGI) {
+        update_events(fd, events);
     } else {
-        // Pipe closed, CGI is done
-        c->state = STATE_WRITING_RESPONSE;
-        close(pipe_fd);
-        _cgi_fds.erase(pipe_fd);
-        _poll_fds.erase(_poll_fds.begin() + poll_idx);
-        poll_idx--; // Adjust loop index
-
-        // Find client socket in poll_fds to switch to POLLOUT
-        for (size_t i = 0; i < _poll_fds.size(); ++i) {
-            if (_poll_fds[i].fd == c->fd) {
-                _poll_fds[i].events = static_cast<short>(POLLIN | POLLOUT);
-                break;
-            }
-        }
+        _watch(fd, FD_ROLE_FASTCGI, events);
     }
 }
 
-void Server::run() {
-    while (!g_shutdown_requested) {
-        int poll_count = poll(&_poll_fds[0], _poll_fds.size(), 1000);
-        if (poll_count < 0) break;
+void Server::fastcgi_unwatch(int fd) {
+    _unwatch(fd);
+}
 
-        for (size_t i = 0; i < _poll_fds.size(); ++i) {
-            int fd = _poll_fds[i].fd;
+void Server::fastcgi_output(Client &c, const char *data, size_t len) {
+    // Malformed headers are answered with 502 once the request ends
+    forward_cgi_output(c, data, len);
+}
 
-            if (_poll_fds[i].revents & POLLIN) {
-                if (is_listener(fd)) {
-                    accept_new_connection(fd);
-                } else if (_clients.count(fd)) {
-                    handle_client_read(fd, *_clients[fd]);
-                } else if (_cgi_fds.count(fd)) {
-                    // This is a CGI pipe ready to be read
-                    handle_cgi_read(fd, i);
-                }
-            }
+void Server::fastcgi_finished(Client &c, bool ok) {
+    finish_cgi_response(c, ok);
+}
 
-            if (_poll_fds[i].revents & POLLOUT) {
-                if (_clients.count(fd))
-                    handle_client_write(fd, *_clients[fd]);
-            }
+// Script output goes to the client as soon as its headers are complete.
+// Returns false when the headers are malformed.
+bool Server::forward_cgi_output(Client &c, const char *data, size_t len) {
+    if (c.cgi_response.feed(data, len, c.output) == CgiResponse::CGI_ERROR) {
+        return false;
+    }
+    if (!c.cgi_response.headers_sent()) {
+        return true;
+    }
+    update_events(c.fd, EVENT_WRITE);
+    if (!c.cgi_paused && c.output.memory_bytes() >= kCgiHighWater) {
+        set_cgi_paused(c, true);
+    }
+    return true;
+}
 
-            // --- State Transitions ---
-            if (_clients.count(fd)) {
-                Client *c = _clients[fd];
-                if (c->state == STATE_PROCESSING) {
-                    process_request(*c);
-                }
-                
-                // Cleanup finished clients
-                if (c->state == STATE_DONE || c->state == STATE_ERROR) {
-                    std::cout << "Closing connection on FD " << fd << std::endl;
-                    close(fd);
-                    delete _clients[fd];
-                    _clients.erase(fd);
-                    _poll_fds.erase(_poll_fds.begin() + i);
-                    --i;
-                }
-            }
+// Flow control: the script blocks on its pipe (or the backend on its
+// socket) instead of the queue growing without bound
+void Server::set_cgi_paused(Client &c, bool paused) {
+    c.cgi_paused = paused;
+    if (c.cgi_pipe_fd != -1) {
+        update_events(c.cgi_pipe_fd, paused ? 0 : EVENT_READ);
+    } else if (c.fastcgi) {
+        _fastcgi.set_paused(c, paused);
+    }
+}
+
+// The script is done: close the body, or answer 502 when it never sent
+// usable headers. A response cut short after its headers only closes.
+void Server::finish_cgi_response(Client &c, bool ok) {
+    c.cgi_paused = false;
+    bool finished = ok && c.cgi_response.finish(c.output);
+    if (finished) {
+        if (!c.cgi_response.keep_alive()) {
+            c.close_after_write = true;
         }
-        // The Zombie Killer
-        waitpid(-1, NULL, WNOHANG);
-        apply_timeout_check();
+    } else if (!c.cgi_response.headers_sent()) {
+        Request req;
+        const RouteConfig &route = select_route(req, *c.config);
+        Response res(502, "Bad Gateway", *c.config, route);
+        c.close_after_write = true;
+        queue_response(c, res);
+    } else {
+        c.close_after_write = true;
     }
-    cleanup();
+    c.state = STATE_WRITING_RESPONSE;
+    update_events(c.fd, EVENT_WRITE);
+    refresh_timer(c);
+    end_cache_fill(c, finished); // A failed script leaves nothing to store
 }
 
-const ServerConfig& Server::select_config(const Request &req, const Client &c) const {
-    const ServerConfig *fallback = NULL;
-    std::string host = req.get_header("Host");
-    size_t colon = host.find(':');
-    if (colon != std::string::npos) {
-        host = host.substr(0, colon);
+void Server::track_child(pid_t pid, int client_fd, const RouteConfig &route) {
+    CgiChild *child = new CgiChild();
+    child->pid = pid;
+    child->client_fd = client_fd;
+    child->terminating = false;
+    child->gate = &route;
+    child->timer.id = -static_cast<int>(pid);
+    _children[pid] = child;
+}
+
+// Asks the script to stop, then kills it if it is still around after
+// kCgiKillGraceMs
+void Server::terminate_child(pid_t pid) {
+    std::map<pid_t, CgiChild*>::iterator it = _children.find(pid);
+    if (it == _children.end() || it->second->terminating) {
+        return;
     }
+    kill(pid, SIGTERM);
+    it->second->terminating = true;
+    _timers.schedule(it->second->timer, _now + kCgiKillGraceMs);
+}
 
-    for (size_t i = 0; i < _configs.size(); ++i) {
-        if (_configs[i].port != c.listen_port) {
+void Server::kill_child(pid_t pid) {
+    if (_children.count(pid)) {
+        std::cerr << "CGI " << pid << " ignored SIGTERM, killing it" << std::endl;
+        kill(pid, SIGKILL);
+    }
+}
+
+// Only pids still in _children are signalled, so a recycled pid is never hit
+void Server::reap_children() {
+    std::vector<ExitedChild> exited;
+    _reaper.reap(exited);
+    for (size_t i = 0; i < exited.size(); ++i) {
+        std::map<pid_t, CgiChild*>::iterator it = _children.find(exited[i].pid);
+        if (it == _children.end()) {
             continue;
         }
-        if (!fallback) {
-            fallback = &_configs[i];
+        int status = exited[i].status;
+        if (WIFSIGNALED(status)) {
+            std::cerr << "CGI " << exited[i].pid << " killed by signal " << WTERMSIG(status) << std::endl;
+        } else if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+            std::cerr << "CGI " << exited[i].pid << " exited with status " << WEXITSTATUS(status) << std::endl;
         }
-        if (!host.empty() && _configs[i].server_name == host) {
-            return _configs[i];
+        const RouteConfig *gate = it->second->gate;
+        _timers.cancel(it->second->timer);
+        delete it->second;
+        _children.erase(it);
+        _cgi_queue.release(gate);
+        admit_cgi_waiters(gate);
+    }
+}
+
+// Replays queued requests while their location has free slots
+void Server::admit_cgi_waiters(const RouteConfig *route) {
+    int fd;
+    while (_cgi_queue.next_waiter(route, _now, fd)) {
+        Client *w = _clients.client_at(fd);
+        if (w && w->cgi_queue == route) {
+            w->cgi_queue = NULL;
+            replay_request(*w);
         }
     }
-    if (fallback) {
-        return *fallback;
+}
+
+void Server::queue_busy_response(Client &c) {
+    const std::string &raw = _busy_response->data();
+    c.close_after_write = true;
+    queue_cached_response(c, _busy_response, raw.size() - std::strlen(kBusyBody), false);
+}
+
+// Stops reading the script; whatever body it did not read is dropped
+void Server::close_cgi_pipe(Client &c) {
+    if (c.cgi_pipe_fd != -1) {
+        _unwatch(c.cgi_pipe_fd);
+        close(c.cgi_pipe_fd);
+        _clients.detach(c.cgi_pipe_fd);
+        c.cgi_pipe_fd = -1;
     }
-    static ServerConfig default_config;
-    default_config.root = "./www";
-    default_config.index = "index.html";
-    return default_config;
+    close_cgi_input(c);
 }
 
-RouteConfig Server::select_route(const Request &req, const ServerConfig &config) const {
-    RouteConfig best_match;
-    bool found = false;
-    size_t best_len = 0;
-    for (size_t i = 0; i < config.routes.size(); ++i) {
-        const RouteConfig &route = config.routes[i];
-        if (req.get_path().find(route.path) == 0 && route.path.size() >= best_len) {
-            best_match = route;
-            best_len = route.path.size();
-            found = true;
-        }
-    }
-    if (!found) {
-        best_match.path = "/";
-        best_match.autoindex_set = true;
-        best_match.autoindex = config.autoindex;
-        best_match.root = config.root;
-        best_match.index = config.index;
-        best_match.upload_dir = config.upload_dir;
-        best_match.allowed_methods = config.allowed_methods;
-        best_match.cgi_extensions = config.cgi_extensions;
-        best_match.max_body_size = config.max_body_size;
-        best_match.max_body_size_set = true;
-    } else {
-        if (!best_match.autoindex_set) {
-            best_match.autoindex = config.autoindex;
-            best_match.autoindex_set = true;
+void Server::close_cgi_input(Client &c) {
+    if (c.cgi_stdin_fd != -1) {
+        if (_role_of(c.cgi_stdin_fd) == FD_ROLE_CGI_INPUT) {
+            _unwatch(c.cgi_stdin_fd);
+            _clients.detach(c.cgi_stdin_fd);
         }
-        if (best_match.root.empty()) {
-            best_match.root = config.root;
+        close(c.cgi_stdin_fd);
+        c.cgi_stdin_fd = -1;
+    }
+    if (c.cgi_input_fd != -1) {
+        close(c.cgi_input_fd);
+        c.cgi_input_fd = -1;
+    }
+    Client::recycle_buffer(c.cgi_input);
+    c.cgi_input_offset = 0;
+    c.cgi_input_size = 0;
+}
+
+void Server::handle_cgi_write(int stdin_fd) {
+    Client *c = _clients.find(stdin_fd);
+    if (!c) {
+        return;
+    }
+    ssize_t written;
+    if (c->cgi_input_fd != -1) {
+        char buffer[65536];
+        off_t left = c->cgi_input_size - c->cgi_input_offset;
+        size_t want = left < static_cast<off_t>(sizeof(buffer)) ? static_cast<size_t>(left) : sizeof(buffer);
+        ssize_t bytes = pread(c->cgi_input_fd, buffer, want, c->cgi_input_offset);
+        if (bytes <= 0) {
+            std::cerr << "Could not read spooled CGI body for FD " << c->fd << std::endl;
+            close_cgi_input(*c);
+            return;
+        }
+        written = write(stdin_fd, buffer, bytes);
+    } else {
+        written = write(stdin_fd, c->cgi_input.data() + c->cgi_input_offset,
+                        static_cast<size_t>(c->cgi_input_size - c->cgi_input_offset));
+    }
+    if (written < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return; // Pipe full: the script has not caught up yet
         }
-        if (best_match.index.empty()) {
-            best_match.index = config.index;
+        close_cgi_input(*c); // EPIPE: the script stopped reading its input
+        return;
+    }
+    c->cgi_input_offset += written;
+    if (c->cgi_input_offset == c->cgi_input_size) {
+        close_cgi_input(*c);
+    }
+}
+
+void Server::handle_cgi_read(int pipe_fd) {
+    Client *c = _clients.find(pipe_fd);
+    char buffer[65536];
+    int bytes = read(pipe_fd, buffer, sizeof(buffer));
+
+    if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    if (bytes > 0) {
+        c->cgi_output_bytes += bytes;
+        size_t limit = c->config->cgi_max_output;
+        if (limit > 0 && c->cgi_output_bytes > limit) {
+            std::cerr << "CGI " << c->cgi_pid << " exceeded cgi_max_output (" << limit << " bytes)" << std::endl;
+        } else if (!forward_cgi_output(*c, buffer, bytes)) {
+            std::cerr << "Malformed CGI headers from " << c->cgi_pid << std::endl;
+        } else {
+            return;
         }
-        if (best_match.upload_dir.empty()) {
-            best_match.upload_dir = config.upload_dir;
+        terminate_child(c->cgi_pid);
+        close_cgi_pipe(*c);
+        finish_cgi_response(*c, false); // 502, or a cut once headers went out
+        return;
+    }
+    // Pipe closed, CGI is done
+    close_cgi_pipe(*c);
+    finish_cgi_response(*c, bytes == 0);
+}
+
+void Server::report_connection_stats() {
+    _next_stats = _now + kStatsIntervalMs;
+    _cgi_queue.report(std::cout);
+    if (_clients.live() == 0) {
+        return;
+    }
+    std::cout << "Connections: " << _clients.live() << " live, " << _clients.pooled() << " pooled, "
+              << _clients.memory_bytes() << " bytes held" << std::endl;
+}
+
+void Server::run() {
+    if (!_events) {
+        _events = EventBackend::create(_global.event_backend);
+    }
+    std::cout << "Using " << _events->name() << " event backend" << std::endl;
+    _clients.reserve(kPooledClients);
+    _reaper.open();
+    _watch(_reaper.fd(), FD_ROLE_REAPER, EVENT_READ);
+
+    std::vector<Event> ready;
+    while (!g_shutdown_requested) {
+        // Sleep no longer than the nearest deadline
+        int ready_count = _events->wait(ready, _timers.next_timeout(_now, 1000));
+        _now = monotonic_ms();
+        if (ready_count < 0) {
+            if (errno == EINTR) continue;
+            break;
         }
-        if (best_match.allowed_methods.empty()) {
-            best_match.allowed_methods = config.allowed_methods;
+
+        for (size_t i = 0; i < ready.size(); ++i) {
+            int fd = ready[i].fd;
+            int events = ready[i].events;
+            // Hangups and errors are reported as readable so the read path sees EOF
+            bool readable = (events & (EVENT_READ | EVENT_HUP | EVENT_ERROR)) != 0;
+
+            switch (_role_of(fd)) {
+            case FD_ROLE_LISTENER:
+                if (readable)
+                    accept_new_connection(fd);
+                break;
+            case FD_ROLE_CGI_INPUT:
+                // Writable, or the script closed its stdin (write sees EPIPE)
+                if ((events & (EVENT_WRITE | EVENT_HUP | EVENT_ERROR)) && _clients.find(fd))
+                    handle_cgi_write(fd);
+                break;
+            case FD_ROLE_CGI:
+                // This is a CGI pipe ready to be read
+                if (readable && _clients.find(fd))
+                    handle_cgi_read(fd);
+                break;
+            case FD_ROLE_REAPER:
+                reap_children();
+                break;
+            case FD_ROLE_FASTCGI:
+                _fastcgi.handle(fd, events);
+                break;
+            case FD_ROLE_CLIENT: {
+                Client *c = _clients.client_at(fd);
+                if (!c)
+                    break;
+                if ((events & (EVENT_HUP | EVENT_ERROR)) && c->state != STATE_READING_REQUEST)
+                    c->state = STATE_ERROR; // Peer is gone, nothing left to deliver
+                else if (readable)
+                    handle_client_read(fd, *c);
+                if ((events & EVENT_WRITE)
+                        && (c->state == STATE_WRITING_RESPONSE || c->state == STATE_WAITING_FOR_CGI))
+                    handle_client_write(fd, *c); // Streamed script output included
+
+                // --- State Transitions ---
+                while (c->state == STATE_PROCESSING) {
+                    process_request(*c);
+                    // Serve pipelined requests now so their responses share one send
+                    if (c->state == STATE_WRITING_RESPONSE && !c->close_after_write
+                            && c->gzip_fd == -1 && !c->request_buffer.empty()) {
+                        c->state = STATE_READING_REQUEST;
+                        parse_request(*c);
+                        if (c->state == STATE_READING_REQUEST)
+                            c->state = STATE_WRITING_RESPONSE; // Rest arrives after the flush
+                    }
+                }
+                // Cleanup finished clients
+                if (c->state == STATE_DONE || c->state == STATE_ERROR) {
+                    close_client(fd);
+                } else {
+                    refresh_timer(*c);
+                }
+                break;
+            }
+            default:
+                break; // Stale event for an fd closed earlier in this batch
+            }
         }
-        if (best_match.cgi_extensions.empty()) {
-            best_match.cgi_extensions = config.cgi_extensions;
+        apply_timeout_check();
+        if (_now >= _next_stats) {
+            report_connection_stats();
         }
-        if (!best_match.max_body_size_set) {
-            best_match.max_body_size = config.max_body_size;
-            best_match.max_body_size_set = true;
+    }
+    cleanup();
+}
+
+static ServerConfig make_default_config() {
+    ServerConfig config;
+    config.root = "./www";
+    config.index = "index.html";
+    return config;
+}
+
+const ServerConfig& Server::select_config(const Request &req, const Client &c) const {
+    if (c.listener_id >= 0 && static_cast<size_t>(c.listener_id) < _listeners.size()) {
+        const VhostIndex &vhosts = _listeners[c.listener_id].vhosts;
+        size_t host_len = 0;
+        const char *host = req.get_header_ref("Host", host_len);
+        const ServerConfig *config = host ? vhosts.select(host, host_len) : vhosts.default_config();
+        if (config) {
+            return *config;
         }
     }
-    return best_match;
+    static ServerConfig default_config = make_default_config();
+    static RouteTable default_routes(default_config);
+    default_config.route_table = &default_routes;
+    return default_config;
+}
+
+const RouteConfig& Server::select_route(const Request &req, const ServerConfig &config) const {
+    return config.route_table->match(req.get_path());
 }
 
 bool Server::is_method_allowed(const std::string &method, const RouteConfig &route) const {
@@ -499,8 +1463,12 @@ bool Server::is_method_allowed(const std::string &method, const RouteConfig &rou
     return false;
 }
 
+// Every request in a fastcgi_pass location goes to the backend
 bool Server::is_cgi_request(const std::string &path, const RouteConfig &route, const ServerConfig &config) const {
-    std::vector<std::string> extensions = route.cgi_extensions.empty() ? config.cgi_extensions : route.cgi_extensions;
+    if (!route.fastcgi_pass.empty()) {
+        return true;
+    }
+    const std::vector<std::string> &extensions = route.cgi_extensions.empty() ? config.cgi_extensions : route.cgi_extensions;
     if (extensions.empty()) {
         return false;
     }
@@ -517,22 +1485,123 @@ bool Server::is_cgi_request(const std::string &path, const RouteConfig &route, c
     return false;
 }
 
+// Empty when the script is executed directly
+std::string Server::cgi_interpreter(const std::string &path, const RouteConfig &route, const ServerConfig &config) const {
+    const std::map<std::string, std::string> &interpreters =
+        route.cgi_extensions.empty() ? config.cgi_interpreters : route.cgi_interpreters;
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) {
+        return "";
+    }
+    std::map<std::string, std::string>::const_iterator it = interpreters.find(path.substr(dot));
+    return it == interpreters.end() ? "" : it->second;
+}
+
+e_timeout Server::timeout_for(const Client &c) const {
+    switch (c.state) {
+    case STATE_READING_REQUEST:
+        if (c.header_parsed) {
+            return TIMEOUT_BODY;
+        }
+        if (c.requests_served > 0 && c.request_buffer.empty()) {
+            return TIMEOUT_KEEPALIVE;
+        }
+        return TIMEOUT_HEADER;
+    case STATE_WAITING_FOR_CGI:
+        return c.cgi_queue ? TIMEOUT_QUEUE : TIMEOUT_CGI;
+    case STATE_WRITING_RESPONSE:
+        return TIMEOUT_SEND;
+    default:
+        return TIMEOUT_NONE;
+    }
+}
+
+// Re-arms the client's single timer for the phase it is in. Header,
+// keep-alive and CGI deadlines count from the start of the phase; body and
+// send deadlines restart whenever the connection made progress.
+void Server::refresh_timer(Client &c) {
+    e_timeout kind = timeout_for(c);
+    if (kind == TIMEOUT_NONE) {
+        _timers.cancel(c.timer);
+        c.timeout_kind = kind;
+        return;
+    }
+    if (kind == c.timeout_kind && c.timer.armed() && kind != TIMEOUT_BODY && kind != TIMEOUT_SEND) {
+        return;
+    }
+    const ServerConfig &config = *c.config;
+    time_t seconds = config.client_header_timeout;
+    if (kind == TIMEOUT_BODY) {
+        seconds = config.client_body_timeout;
+    } else if (kind == TIMEOUT_SEND) {
+        seconds = config.send_timeout;
+    } else if (kind == TIMEOUT_KEEPALIVE) {
+        seconds = config.keepalive_timeout;
+    } else if (kind == TIMEOUT_CGI) {
+        seconds = config.cgi_timeout;
+    } else if (kind == TIMEOUT_QUEUE) {
+        seconds = c.cgi_queue->cgi_queue_timeout;
+    }
+    c.timeout_kind = kind;
+    _timers.schedule(c.timer, _now + static_cast<msec_t>(seconds) * 1000);
+}
+
+// Only clients whose deadline passed are visited
 void Server::apply_timeout_check() {
-    const time_t kClientTimeout = 30;
-    time_t now = time(NULL);
-    for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
-        Client *c = it->second;
-        if (c->state == STATE_DONE || c->state == STATE_ERROR || c->state == STATE_WRITING_RESPONSE) {
+    std::vector<int> expired;
+    _timers.expire(_now, expired);
+    for (size_t i = 0; i < expired.size(); ++i) {
+        if (expired[i] < 0) {
+            kill_child(-expired[i]); // SIGTERM grace period is over
+            continue;
+        }
+        Client *c = _clients.client_at(expired[i]);
+        if (!c) {
+            continue;
+        }
+        if (c->timeout_kind == TIMEOUT_KEEPALIVE || c->timeout_kind == TIMEOUT_SEND) {
+            // Nothing useful can be sent: close quietly
+            std::cout << "Connection on FD " << c->fd << " timed out" << std::endl;
+            close_client(c->fd);
             continue;
         }
-        if (now - c->last_activity > kClientTimeout) {
-            Request req("GET / HTTP/1.1\r\n\r\n");
-            const ServerConfig &config = select_config(req, *c);
-            RouteConfig route = select_route(req, config);
+        if (c->timeout_kind == TIMEOUT_QUEUE) {
+            std::cerr << "FD " << c->fd << " gave up waiting for a CGI slot" << std::endl;
+            _cgi_queue.cancel(c->cgi_queue, c->fd, true);
+            c->cgi_queue = NULL;
+            queue_busy_response(*c);
+            refresh_timer(*c);
+            continue;
+        }
+        Request req; // Nothing parsed: falls back to the port's default server
+        const ServerConfig &config = select_config(req, *c);
+        const RouteConfig &route = select_route(req, config);
+        c->close_after_write = true;
+        if (c->timeout_kind == TIMEOUT_CGI) {
+            std::cerr << "CGI for FD " << c->fd << " timed out" << std::endl;
+            bool ran_script = c->cache_role != CACHE_WAITING;
+            if (!ran_script) {
+                _cgi_cache.cancel_wait(c->cache_key, c->fd);
+                c->cache_role = CACHE_NONE;
+                c->cache_key.clear();
+            } else if (c->fastcgi) {
+                _fastcgi.abort(*c);
+            } else {
+                terminate_child(c->cgi_pid);
+                close_cgi_pipe(*c);
+            }
+            end_cache_fill(*c, false); // Waiters run their own script
+            if (ran_script && c->cgi_response.headers_sent()) {
+                close_client(c->fd); // Too late for a 504
+                continue;
+            }
+            Response res(504, "Gateway Timeout", config, route);
+            queue_response(*c, res);
+        } else {
+            c->discard_body_sink();
             Response res(408, "Request Timeout", config, route);
-            c->response_buffer = res.get_raw_response();
-            c->state = STATE_WRITING_RESPONSE;
-            update_poll_events(c->fd, POLLIN | POLLOUT);
+            queue_response(*c, res);
         }
+        refresh_timer(*c);
     }
 }
@@ -24,52 +24,157 @@
 #include <cstring>
 #include <vector>
 #include <map>
-#include <poll.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <signal.h>
 
 #include "Request.hpp"
 #include "Response.hpp"
 #include "CgiHandler.hpp"
 #include "Client.hpp"
+#include "ClientPool.hpp"
 #include "Config.hpp"
+#include "EventBackend.hpp"
+#include "StaticCache.hpp"
+#include "CgiCache.hpp"
+#include "RouteTable.hpp"
+#include "VhostIndex.hpp"
+#include "TimerWheel.hpp"
+#include "ChildReaper.hpp"
+#include "CgiQueue.hpp"
+#include "FastCgiClient.hpp"
 
-class Server {
+// What a registered fd is, so dispatch never has to search
+enum e_fd_role {
+    FD_ROLE_NONE,
+    FD_ROLE_LISTENER,
+    FD_ROLE_CLIENT,
+    FD_ROLE_CGI,
+    FD_ROLE_CGI_INPUT,
+    FD_ROLE_FASTCGI,
+    FD_ROLE_REAPER
+};
+
+struct Listener {
+    std::string     host;
+    int             port;
+    int             fd;
+    VhostIndex      vhosts;     // Server blocks sharing this address
+    ListenOptions   options;    // From the first block naming the address
+    time_t          defer_seconds;
+};
+
+// A spawned script, from launch until the reaper collects it
+struct CgiChild {
+    pid_t       pid;
+    int         client_fd;      // -1 once its client is gone
+    bool        terminating;    // SIGTERM sent, SIGKILL armed on 'timer'
+    const RouteConfig *gate;    // Location whose cgi_max_concurrent slot it holds
+    TimerNode   timer;          // Id is -pid, apart from client fds
+};
+
+class Server : public FastCgiEvents {
 private:
     std::vector<int>        _listen_fds;
-    std::vector<pollfd>     _poll_fds;
+    std::vector<Listener>   _listeners;
+    std::map<int, size_t>   _listener_by_fd;  // Key: listen fd, value: index in _listeners
     std::vector<ServerConfig> _configs;
-    std::map<int, int>      _listener_ports;
-    
-    // Maps for tracking ownership
-    std::map<int, Client*>  _clients;     // Key: socket_fd
-    std::map<int, Client*>  _cgi_fds;      // Key: pipe_fd (maps pipe back to client)
+    std::vector<RouteTable*> _route_tables; // One per entry of _configs
+    GlobalConfig            _global;
+    EventBackend            *_events;
+    bool                    _reuse_port;  // One listener per worker on the same port
+    std::vector<char>       _fd_roles;    // Key: fd, value: e_fd_role
+    std::vector<char>       _recv_buffer; // client_receive_buffer_max bytes, shared by all reads
+    StaticCache             _static_cache;
+    CgiCache                _cgi_cache;   // cgi_cache locations, with collapsed fills
+    unsigned long           _upload_seq;  // Makes temporary upload names unique
+    msec_t                  _now;         // Loop clock, read once per wakeup
+    TimerWheel              _timers;      // One deadline per client
+    msec_t                  _next_stats;  // When live connection memory is next logged
+
+    ClientPool              _clients;     // Key: socket or CGI pipe fd, value: owning client
+    FastCgiClient           _fastcgi;     // Backend connections for fastcgi_pass locations
+    ChildReaper             _reaper;      // SIGCHLD as a readable fd
+    std::map<pid_t, CgiChild*> _children; // Scripts not reaped yet
+    CgiQueue                _cgi_queue;   // cgi_max_concurrent slots and waiters
+    SharedBuffer            *_busy_response; // Prebuilt 503 for a full CGI queue
+
+    Server(const Server &);
+    Server &operator=(const Server &);
+
+    void    _watch(int fd, e_fd_role role, int events);
+    void    _unwatch(int fd);
+    e_fd_role _role_of(int fd) const;
 
 public:
     Server();
     ~Server();
 
     void    set_configs(const std::vector<ServerConfig> &configs);
+    void    set_global_config(const GlobalConfig &global);
 
     // Core Engine
-    void    setup_server(int port);
+    void    setup_listeners();
+    int     setup_server(const Listener &listener);
     void    run();
     
     // Event Handlers
     void    accept_new_connection(int listen_fd);
     void    handle_client_read(int fd, Client &c);
     void    handle_client_write(int fd, Client &c);
-    void    handle_cgi_read(int pipe_fd, size_t &poll_idx);
-    
+    void    handle_cgi_read(int pipe_fd);
+    void    handle_cgi_write(int stdin_fd);
+    void    start_cgi_input(Client &c, int stdin_fd);
+    void    close_cgi_input(Client &c);
+    int     take_spooled_body(Client &c);
+    void    start_cgi(Client &c, const ServerConfig &config, const RouteConfig &route, bool keep_alive);
+    void    start_fastcgi(Client &c, const ServerConfig &config, const RouteConfig &route, bool keep_alive);
+    void    fastcgi_watch(int fd, int events);
+    void    fastcgi_unwatch(int fd);
+    void    fastcgi_output(Client &c, const char *data, size_t len);
+    void    fastcgi_finished(Client &c, bool ok);
+    bool    forward_cgi_output(Client &c, const char *data, size_t len);
+    void    set_cgi_paused(Client &c, bool paused);
+    void    finish_cgi_response(Client &c, bool ok);
+    void    close_cgi_pipe(Client &c);
+    void    track_child(pid_t pid, int client_fd, const RouteConfig &route);
+    void    terminate_child(pid_t pid);
+    void    kill_child(pid_t pid);
+    void    reap_children();
+    void    admit_cgi_waiters(const RouteConfig *route);
+    void    queue_busy_response(Client &c);
+    void    parse_request(Client &c);
+    void    finish_response(Client &c);
+    void    queue_response(Client &c, std::string &raw);
+    void    queue_response(Client &c, Response &res);
+    void    queue_file_body(Client &c, Response &res);
+    void    queue_gzip_body(Client &c, Response &res);
+    void    pump_gzip_body(Client &c);
+    void    queue_cached_response(Client &c, SharedBuffer *response, size_t head_size, bool keep_alive);
+    std::string static_cache_key(const Request &req, const ServerConfig &config, const RouteConfig &route) const;
+    std::string cgi_cache_key(const Request &req, const ServerConfig &config, const RouteConfig &route) const;
+    void    end_cache_fill(Client &c, bool finished);
+    void    replay_request(Client &c);
+    bool    is_upload_request(const Request &req, const RouteConfig &route, const ServerConfig &config) const;
+    bool    open_body_sink(Client &c, const std::string &upload_dir);
+    bool    commit_body_sink(Client &c, const std::string &upload_dir);
+    void    fail_body_sink(Client &c);
+    bool    wants_keep_alive(const Request &req, const Client &c, const ServerConfig &config) const;
+
     // Helpers
-    bool    is_listener(int fd);
+    bool    is_listener(int fd) const;
     void    process_request(Client &c);
-    void    update_poll_events(int fd, short events);
+    void    update_events(int fd, int events);
+    void    close_client(int fd);
     const ServerConfig& select_config(const Request &req, const Client &c) const;
-    RouteConfig select_route(const Request &req, const ServerConfig &config) const;
+    const RouteConfig& select_route(const Request &req, const ServerConfig &config) const;
     void    apply_timeout_check();
+    e_timeout timeout_for(const Client &c) const;
+    void    refresh_timer(Client &c);
     bool    is_method_allowed(const std::string &method, const RouteConfig &route) const;
     bool    is_cgi_request(const std::string &path, const RouteConfig &route, const ServerConfig &config) const;
+    std::string cgi_interpreter(const std::string &path, const RouteConfig &route, const ServerConfig &config) const;
+    void    report_connection_stats();
     void    cleanup();
 };
 
@@ -0,0 +1,125 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   VhostIndex.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "VhostIndex.hpp"
+#include <cctype>
+#include <strings.h>
+
+static const size_t kInitialSlots = 16;
+
+VhostIndex::VhostIndex() : _exact_count(0), _wildcard_count(0), _default(NULL) {}
+
+// FNV-1a over the lowercased bytes
+size_t VhostIndex::_hash(const char *data, size_t len) {
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(data[i])));
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void VhostIndex::_insert(std::vector<Slot> &table, size_t &count, const std::string &name,
+                         const ServerConfig *config) {
+    // Keep the load factor under one half so probe chains stay short
+    if (table.empty() || (count + 1) * 2 > table.size()) {
+        std::vector<Slot> old;
+        old.swap(table);
+        Slot empty;
+        empty.config = NULL;
+        table.assign(old.empty() ? kInitialSlots : old.size() * 2, empty);
+        count = 0;
+        for (size_t i = 0; i < old.size(); ++i) {
+            if (!old[i].name.empty()) {
+                _insert(table, count, old[i].name, old[i].config);
+            }
+        }
+    }
+    size_t mask = table.size() - 1;
+    size_t idx = _hash(name.data(), name.size()) & mask;
+    while (!table[idx].name.empty()) {
+        if (table[idx].name == name) {
+            return; // First block declaring a name keeps it
+        }
+        idx = (idx + 1) & mask;
+    }
+    table[idx].name = name;
+    table[idx].config = config;
+    ++count;
+}
+
+const ServerConfig* VhostIndex::_find(const std::vector<Slot> &table, const char *data, size_t len) {
+    if (table.empty() || len == 0) {
+        return NULL;
+    }
+    size_t mask = table.size() - 1;
+    size_t idx = _hash(data, len) & mask;
+    while (!table[idx].name.empty()) {
+        const std::string &name = table[idx].name;
+        if (name.size() == len && strncasecmp(name.data(), data, len) == 0) {
+            return table[idx].config;
+        }
+        idx = (idx + 1) & mask;
+    }
+    return NULL;
+}
+
+void VhostIndex::add(const ServerConfig *config) {
+    if (!_default) {
+        _default = config;
+    }
+    for (size_t i = 0; i < config->server_names.size(); ++i) {
+        std::string name = config->server_names[i];
+        for (size_t j = 0; j < name.size(); ++j) {
+            name[j] = static_cast<char>(std::tolower(static_cast<unsigned char>(name[j])));
+        }
+        if (name.size() > 2 && name[0] == '*' && name[1] == '.') {
+            _insert(_wildcard, _wildcard_count, name.substr(2), config);
+        } else if (!name.empty()) {
+            _insert(_exact, _exact_count, name, config);
+        }
+    }
+}
+
+const ServerConfig* VhostIndex::select(const char *host, size_t len) const {
+    // Strip ":port" and a trailing dot; IPv6 literals keep their brackets
+    size_t end = len;
+    for (size_t i = len; i > 0; --i) {
+        if (host[i - 1] == ':') {
+            end = i - 1;
+            break;
+        }
+        if (host[i - 1] == ']' || !std::isdigit(static_cast<unsigned char>(host[i - 1]))) {
+            break;
+        }
+    }
+    if (end > 0 && host[end - 1] == '.') {
+        --end;
+    }
+
+    const ServerConfig *found = _find(_exact, host, end);
+    if (found) {
+        return found;
+    }
+    // Longest wildcard suffix first: a.b.example.com tries b.example.com, then example.com
+    if (_wildcard_count > 0) {
+        for (size_t i = 0; i < end; ++i) {
+            if (host[i] == '.') {
+                found = _find(_wildcard, host + i + 1, end - i - 1);
+                if (found) {
+                    return found;
+                }
+            }
+        }
+    }
+    return _default;
+}
@@ -0,0 +1,51 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   VhostIndex.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: eaqrabaw <eaqrabaw@student.42amman.com>    +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2026/10/17 10:00:00 by eaqrabaw          #+#    #+#             */
+/*   Updated: 2026/10/17 10:00:00 by eaqrabaw         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef VHOST_INDEX_HPP
+#define VHOST_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include "Config.hpp"
+
+// Per-listener map from Host header to server block. Exact names and
+// '*.example.com' wildcards live in two open-addressing hash tables, and
+// lookups hash the raw header bytes case-insensitively, so selection costs
+// O(1) for exact names (O(labels) for wildcards) however many vhosts exist.
+class VhostIndex {
+private:
+    struct Slot {
+        std::string         name;    // Lowercase, empty when unused
+        const ServerConfig  *config;
+    };
+
+    std::vector<Slot>   _exact;
+    std::vector<Slot>   _wildcard;   // Keyed by the suffix after "*."
+    size_t              _exact_count;
+    size_t              _wildcard_count;
+    const ServerConfig  *_default;   // First block on this listener
+
+    static size_t   _hash(const char *data, size_t len);
+    static void     _insert(std::vector<Slot> &table, size_t &count, const std::string &name,
+                            const ServerConfig *config);
+    static const ServerConfig* _find(const std::vector<Slot> &table, const char *data, size_t len);
+
+public:
+    VhostIndex();
+
+    void    add(const ServerConfig *config);
+    // 'host' is the raw Host header value, port and case are handled here
+    const ServerConfig* select(const char *host, size_t len) const;
+    const ServerConfig* default_config() const { return _default; }
+};
+
+#endif
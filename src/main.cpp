@@ -12,6 +12,7 @@
 
 #include "ConfigParser.hpp"
 #include "Server.hpp"
+#include "Master.hpp"
 #include <signal.h>
 
 static void handle_sigint(int) {
@@ -21,22 +22,27 @@ static void handle_sigint(int) {
 int main(int argc, char** argv) {
     std::string config_path = (argc == 2) ? argv[1] : "default.conf";
 
+    std::vector<ServerConfig> configs;
+    GlobalConfig global;
     try {
-        std::vector<ServerConfig> configs = ConfigParser::parse(config_path);
-        Server webserv;
-        webserv.set_configs(configs);
-
-        signal(SIGINT, handle_sigint);
-
-        // Setup a listener for every config block
-        for (size_t i = 0; i < configs.size(); ++i) {
-            webserv.setup_server(configs[i].port);
-        }
-
-        webserv.run();
+        configs = ConfigParser::parse(config_path, global);
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
-    return 0;
+
+    // No SA_RESTART: the master's waitpid() must return when SIGINT arrives
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigint;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    // Writes to a closed socket or CGI stdin pipe must fail with EPIPE, not kill us
+    signal(SIGPIPE, SIG_IGN);
+
+    if (Master::worker_count(global) == 1) {
+        return run_worker(configs, global) == 0 ? 0 : 1;
+    }
+    Master master(configs, global);
+    return master.run();
 }
@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+"""Minimal FastCGI responder for exercising fastcgi_pass by hand.
+
+    tools/fastcgi_responder.py /tmp/fcgi.sock [mpxs]   # unix socket
+    tools/fastcgi_responder.py 9000 [mpxs]             # 127.0.0.1:9000
+
+Each request is answered with one line describing what arrived:
+connection number, request id, body size and md5, SCRIPT_NAME. The query
+string changes the reply:
+
+    cgi     reply with CGI headers instead of an HTTP status line
+    big     append 300000 bytes to the body
+    sleep   wait 3 seconds before replying
+    close   close the connection after replying
+
+'mpxs' answers FCGI_GET_VALUES with FCGI_MPXS_CONNS=1.
+"""
+import hashlib
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+
+FCGI_BEGIN_REQUEST = 1
+FCGI_ABORT_REQUEST = 2
+FCGI_END_REQUEST = 3
+FCGI_PARAMS = 4
+FCGI_STDIN = 5
+FCGI_STDOUT = 6
+FCGI_STDERR = 7
+FCGI_GET_VALUES = 9
+FCGI_GET_VALUES_RESULT = 10
+
+
+def send_record(conn, rtype, rid, data):
+    pad = (8 - len(data) % 8) % 8
+    conn.sendall(struct.pack('>BBHHBB', 1, rtype, rid, len(data), pad, 0) + data + b'\0' * pad)
+
+
+def read_exact(conn, n):
+    data = b''
+    while len(data) < n:
+        chunk = conn.recv(n - len(data))
+        if not chunk:
+            raise EOFError
+        data += chunk
+    return data
+
+
+def parse_params(data):
+    params = {}
+    pos = 0
+
+    def length():
+        nonlocal pos
+        if data[pos] < 128:
+            pos += 1
+            return data[pos - 1]
+        value = struct.unpack('>I', data[pos:pos + 4])[0] & 0x7fffffff
+        pos += 4
+        return value
+
+    while pos < len(data):
+        name_len = length()
+        value_len = length()
+        params[data[pos:pos + name_len]] = data[pos + name_len:pos + name_len + value_len]
+        pos += name_len + value_len
+    return params
+
+
+def serve(conn, conn_id, mpxs):
+    requests = {}
+    try:
+        while True:
+            _, rtype, rid, length, pad, _ = struct.unpack('>BBHHBB', read_exact(conn, 8))
+            data = read_exact(conn, length)
+            read_exact(conn, pad)
+            if rtype == FCGI_GET_VALUES:
+                send_record(conn, FCGI_GET_VALUES_RESULT, 0,
+                            b'\x0f\x01FCGI_MPXS_CONNS' + (b'1' if mpxs else b'0'))
+            elif rtype == FCGI_BEGIN_REQUEST:
+                requests[rid] = {'params': b'', 'md5': hashlib.md5(), 'size': 0}
+            elif rtype == FCGI_PARAMS:
+                requests[rid]['params'] += data
+            elif rtype == FCGI_ABORT_REQUEST:
+                send_record(conn, FCGI_END_REQUEST, rid, b'\0\0\0\0\1\0\0\0')
+                requests.pop(rid, None)
+            elif rtype == FCGI_STDIN:
+                req = requests[rid]
+                if data:
+                    req['md5'].update(data)
+                    req['size'] += len(data)
+                    continue
+                env = parse_params(req['params'])
+                query = env.get(b'QUERY_STRING', b'')
+                if b'sleep' in query:
+                    time.sleep(3)
+                body = b'conn=%d id=%d n=%d md5=%s script=%s\n' % (
+                    conn_id, rid, req['size'], req['md5'].hexdigest().encode(), env.get(b'SCRIPT_NAME'))
+                if b'big' in query:
+                    body += b'x' * 300000
+                send_record(conn, FCGI_STDERR, rid, b'stderr line')
+                if b'cgi' in query:
+                    out = b'Content-Type: text/plain\r\n\r\n' + body
+                else:
+                    out = (b'HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: %d\r\n\r\n'
+                           % len(body)) + body
+                for pos in range(0, len(out), 65535):
+                    send_record(conn, FCGI_STDOUT, rid, out[pos:pos + 65535])
+                send_record(conn, FCGI_STDOUT, rid, b'')
+                send_record(conn, FCGI_END_REQUEST, rid, b'\0\0\0\0\0\0\0\0')
+                del requests[rid]
+                if b'close' in query:
+                    break
+    except (EOFError, OSError):
+        pass
+    conn.close()
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    address = sys.argv[1]
+    mpxs = len(sys.argv) > 2 and sys.argv[2] == 'mpxs'
+    if address.isdigit():
+        sock = socket.socket()
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        sock.bind(('127.0.0.1', int(address)))
+    else:
+        if os.path.exists(address):
+            os.unlink(address)
+        sock = socket.socket(socket.AF_UNIX)
+        sock.bind(address)
+    sock.listen(64)
+    conn_id = 0
+    while True:
+        conn, _ = sock.accept()
+        conn_id += 1
+        threading.Thread(target=serve, args=(conn, conn_id, mpxs), daemon=True).start()
+
+
+if __name__ == '__main__':
+    main()